@@ -11,12 +11,120 @@ extern "C" {
 bool wclap_global_init(unsigned int timeLimitMs);
 void wclap_global_deinit();
 
+typedef enum wclap_allocation_strategy {
+	// Linear memories are mapped as each instance is created
+	WCLAP_ALLOCATION_ON_DEMAND = 0,
+	// One up-front reservation, split into fixed slots (much faster to create instances, but limits how many exist at once)
+	WCLAP_ALLOCATION_POOLING = 1
+} wclap_allocation_strategy;
+
+typedef enum wclap_opt_level {
+	WCLAP_OPT_LEVEL_DEFAULT = -1,
+	WCLAP_OPT_LEVEL_NONE = 0,
+	WCLAP_OPT_LEVEL_SPEED = 1,
+	WCLAP_OPT_LEVEL_SPEED_AND_SIZE = 2
+} wclap_opt_level;
+
+#define WCLAP_GLOBAL_OPTIONS_VERSION 2
+// Engine configuration.  Fill with `wclap_global_options_default()` and then change what you need.
+typedef struct wclap_global_options {
+	// Must be `WCLAP_GLOBAL_OPTIONS_VERSION` (or lower, in which case later fields are ignored)
+	uint32_t version;
+	// 0 means no limit
+	uint32_t time_limit_ms;
+
+	// Negative values keep Wasmtime's defaults (4GiB / 2GiB / 32MiB on 64-bit hosts)
+	// Virtual address space reserved for each linear memory.  Memories which grow past this are moved, so smaller values trade address space for occasional copies.
+	int64_t memory_reservation;
+	// Extra space reserved when a memory is moved, so it can keep growing in-place
+	int64_t memory_reservation_for_growth;
+	// Unmapped region after each memory - smaller guards need more bounds-checks in the compiled code
+	int64_t memory_guard_size;
+	// 0/1 to disable/enable copy-on-write initialisation of memories from the module, negative for the default
+	int32_t memory_init_cow;
+
+	// A `wclap_allocation_strategy`
+	int32_t allocation_strategy;
+	// Pooling only, 0 keeps Wasmtime's defaults (1000 each).  Every `Instance` (main/audio thread, WCLAP threads, isolated copies) uses one core instance, one table and (unless threaded) one memory, so `pool_total_instances` also sets the table count, and the memory count unless `pool_total_memories` is set.
+	uint32_t pool_total_memories;
+	uint32_t pool_total_instances;
+	uint32_t pool_max_unused_warm_slots;
+	uint32_t reserved;
+	uint64_t pool_max_memory_size;
+
+	// Version 2: compilation.  Negative values keep Wasmtime's defaults, otherwise 0/1 to disable/enable.
+	// A `wclap_opt_level` for Cranelift
+	int32_t opt_level;
+	// WASM SIMD (`-msimd128`) and relaxed-SIMD proposals
+	int32_t wasm_simd;
+	int32_t wasm_relaxed_simd;
+	// 64-bit memories, needed for `wclap64` modules
+	int32_t wasm_memory64;
+	// Compile functions on multiple threads, which speeds up scanning large WCLAPs
+	int32_t parallel_compilation;
+	int32_t reserved2;
+	// Target triple, or `NULL` to compile for the host CPU using every feature Wasmtime detects (AVX2/AVX-512, NEON etc.).  Copied.
+	const char *target;
+	// Optional comma-separated Cranelift flags to enable (e.g. "has_avx2,has_fma" with an explicit `target`).  Copied.
+	const char *cranelift_flags;
+} wclap_global_options_t;
+
+void wclap_global_options_default(wclap_global_options_t *options);
+// Like `wclap_global_init()`, with the same rules about reconfiguring
+bool wclap_global_init_with_options(const wclap_global_options_t *options);
+
+typedef struct wclap_memory_footprint {
+	// Wasmtime stores, one for each `Instance` across all open WCLAPs
+	uint64_t stores;
+	// Linear memories: one per threaded WCLAP (shared by its instances), or one per instance for single-threaded WCLAPs
+	uint64_t memories;
+	// Current size of those memories
+	uint64_t memory_bytes;
+	// Estimated virtual address space reserved for memories (including guard regions) outside the pool
+	uint64_t virtual_bytes;
+	// Estimated address space reserved up-front by the pooling allocator (0 if not pooling)
+	uint64_t pool_bytes;
+} wclap_memory_footprint_t;
+
+// Fills in the current footprint, returning `false` if the engine isn't initialised
+bool wclap_get_memory_footprint(wclap_memory_footprint_t *footprint);
+
 // Opens a WCLAP, returning an opaque identifier (or null on failure)
 void * wclap_open(const char *wclapDir);
 
 // Opens a WCLAP with read-only directory `/plugin/` and optional read-write directories `/presets/`, `/cache/` and `/var/`
 void * wclap_open_with_dirs(const char *wclapDir, const char *presetDir, const char *cacheDir, const char *varDir);
 
+typedef enum wclap_open_stage {
+	WCLAP_OPEN_QUEUED = 0,
+	WCLAP_OPEN_READING = 1,
+	WCLAP_OPEN_COMPILING = 2,
+	WCLAP_OPEN_INSTANTIATING = 3,
+	// Running the WCLAP's `_initialize()` and `clap_entry::init()`
+	WCLAP_OPEN_INITIALISING = 4,
+	// Final stages
+	WCLAP_OPEN_DONE = 5,
+	WCLAP_OPEN_FAILED = 6,
+	WCLAP_OPEN_CANCELLED = 7
+} wclap_open_stage;
+// Both called from a bridge worker thread, and never after `wclap_open_async_release()` has returned
+typedef void (*wclap_open_progress_t)(void *context, void *request, wclap_open_stage stage);
+// Called once, with the opened WCLAP (which then belongs to the host, for `wclap_close()`) or `NULL` if it failed (including `clap_entry::init()` failing) or was cancelled
+typedef void (*wclap_open_complete_t)(void *context, void *request, void *wclap);
+
+// Like `wclap_open_with_dirs()`, but runs on a pool of bridge worker threads.  Returns a request handle (never `NULL`), which must be released with `wclap_open_async_release()`.  Callbacks are optional.
+void * wclap_open_async(const char *wclapDir, const char *presetDir, const char *cacheDir, const char *varDir, wclap_open_progress_t progress, wclap_open_complete_t complete, void *context);
+// Current stage of the request
+wclap_open_stage wclap_open_async_stage(void *request);
+// The opened WCLAP once the stage is `WCLAP_OPEN_DONE`, otherwise `NULL`
+void * wclap_open_async_result(void *request);
+// Stops the request before its next stage (a stage which has already started is finished first).  The completion callback is still called.
+void wclap_open_async_cancel(void *request);
+// Frees the request (safe from inside its callbacks).  If it hasn't finished it's cancelled, no more callbacks are made, and any WCLAP it opens is closed.
+void wclap_open_async_release(void *request);
+// Number of worker threads for `wclap_open_async()` (default 2).  Applies when the workers next start (they're stopped by `wclap_global_deinit()`).
+void wclap_set_async_open_threads(uint32_t threads);
+
 // Thread safe, non-blocking unless there's an error (in which case the buffer is filled, and `true` returned)
 bool wclap_get_error(void *, char *buffer, uint32_t bufferCapacity);
 
@@ -40,6 +148,61 @@ const void * wclap_get_factory(void *, const char *factory_id);
 
 void wclap_set_strings(const char *pluginIdPrefix, const char *pluginNamePrefix, const char *pluginNameSuffix);
 
+// Number of warm threads to keep ready for each threaded WCLAP, so that spawning a WCLAP thread doesn't instantiate anything (default 0).  Applies to WCLAPs opened after this call.
+void wclap_set_thread_pool_size(uint32_t warmThreads);
+
+// If enabled, each plugin from a single-threaded WCLAP gets its own instance (and memory), sharing only the compiled code, so they can process in parallel.  Costs one `clap_entry::init()` (and the WCLAP's initial memory) per plugin.  Applies to plugins created after this call.
+void wclap_set_isolated_instances(bool isolate);
+
+// If enabled, single-threaded WCLAPs are snapshotted (memory and exported globals) after `clap_entry::init()`, and isolated instances (above) are restored from that instead of re-running the WCLAP's initialisation.  Applies to WCLAPs opened after this call.
+void wclap_set_init_snapshots(bool enable);
+
+// If enabled, plugins from threaded WCLAPs save/load their state on a dedicated instance (created on first use), so calls from other threads which use the WCLAP's main instance (e.g. from the audio thread) aren't queued behind a large save/load.  Host main-thread calls are blocked by the (synchronous) CLAP state methods anyway.
+void wclap_set_state_instances(bool enable);
+
+// Webview messages (in either direction) are queued, and delivered in batches on the host's main-thread callback.  If `key` is set, it's called for each message, and a queued message is dropped when a newer one has the same non-zero key (e.g. meter updates).  Applies to plugins created after this call.
+typedef uint64_t (*wclap_webview_coalesce_key_t)(void *context, const void *message, uint32_t size, bool to_wclap);
+void wclap_set_webview_coalescing(wclap_webview_coalesce_key_t key, void *context);
+// Space for queued webview messages in each direction (default 64kB / 256 messages).  Each plugin allocates this twice per direction, on first use.  A message which doesn't fit is delivered straight away, after the ones already queued.  Applies to plugins created after this call.
+void wclap_set_webview_queue_size(uint32_t bytes, uint32_t messages);
+
+// Scratch space for sysex output events, reserved per plugin at activation since the audio thread can't allocate (default 64kB).  Events which don't fit are dropped, and reported through the host's log.  Applies to plugins activated after this call.
+void wclap_set_max_sysex_bytes(uint32_t bytes);
+
+// Input events translated for the WCLAP in each process/flush (default 4096 events / 256kB), reserved per plugin at activation.  Events beyond this are dropped, and reported through the host's log.  Applies to plugins activated after this call.
+void wclap_set_input_event_budget(uint32_t maxEvents, uint32_t maxBytes);
+
+typedef enum wclap_memory_lock_mode {
+	WCLAP_MEMORY_LOCK_NONE = 0,
+	// The audio-thread arena and resident audio buffers
+	WCLAP_MEMORY_LOCK_AUDIO = 1,
+	// As above, plus the WCLAP's whole linear memory (as it was when the plugin activated)
+	WCLAP_MEMORY_LOCK_ALL = 2
+} wclap_memory_lock_mode;
+// Prefaults and locks (`mlock()`/`VirtualLock()`) WASM memory used by the audio thread, from activate to deactivate, to avoid page-faults while processing.  Applies to plugins activated after this call.
+void wclap_set_memory_locking(wclap_memory_lock_mode mode);
+// Bytes currently locked by the bridge (across all WCLAPs), for keeping inside `RLIMIT_MEMLOCK`
+uint64_t wclap_locked_memory_bytes();
+
+// Scheduling for threads started by WCLAPs (through `wasi::thread-spawn`), which are often DSP helpers that the audio thread waits on
+typedef struct wclap_thread_policy {
+	// Realtime priority (`SCHED_FIFO` on POSIX, time-critical on Windows), or 0 to leave scheduling alone
+	int32_t realtime_priority;
+	// Niceness (where supported) if there's no realtime priority, or 0 to leave it alone
+	int32_t nice;
+	// Pins threads to these CPU cores (where supported), or 0 to leave affinity alone
+	uint64_t cpu_mask;
+
+	void *context;
+	// Optional: called on each WCLAP thread before it runs any WASM code (e.g. to join an audio workgroup).  Return `false` to leave this thread's scheduling alone.
+	bool (*thread_started)(void *context, uint32_t thread_id);
+	// Optional: called on the same thread once the WCLAP thread has finished (e.g. to leave the workgroup)
+	void (*thread_stopped)(void *context, uint32_t thread_id);
+} wclap_thread_policy_t;
+
+// Sets (or with `NULL`, clears) the policy for WCLAP threads which start after this call.  The struct is copied.
+void wclap_set_thread_policy(const wclap_thread_policy_t *policy);
+
 #ifdef __cplusplus
 }
 #endif
@@ -4,6 +4,8 @@ unsafe extern "C" {
     pub fn wclap_global_init(timeLimitMs: ::std::os::raw::c_uint) -> bool;
     pub fn wclap_global_deinit();
 
+    /* skip wclap_global_options_default(), wclap_global_init_with_options() and wclap_get_memory_footprint() for now */
+
     pub fn wclap_open(wclapDir: *const ::std::os::raw::c_char) -> *mut ::std::os::raw::c_void;
     pub fn wclap_open_with_dirs(
         wclapDir: *const ::std::os::raw::c_char,
@@ -12,6 +14,8 @@ unsafe extern "C" {
         varDir: *const ::std::os::raw::c_char,
     ) -> *mut ::std::os::raw::c_void;
 
+    /* skip wclap_open_async() and its request functions for now */
+
     pub fn wclap_get_error(
         handle: *mut ::std::os::raw::c_void,
         buffer: *mut ::std::os::raw::c_char,
@@ -32,4 +36,24 @@ unsafe extern "C" {
         pluginNamePrefix: *const ::std::os::raw::c_char,
         pluginNameSuffix: *const ::std::os::raw::c_char,
     );
+
+    pub fn wclap_set_thread_pool_size(warmThreads: u32);
+
+    pub fn wclap_set_isolated_instances(isolate: bool);
+
+    pub fn wclap_set_init_snapshots(enable: bool);
+
+    pub fn wclap_set_state_instances(enable: bool);
+
+    pub fn wclap_set_webview_queue_size(bytes: u32, messages: u32);
+
+    pub fn wclap_set_max_sysex_bytes(bytes: u32);
+
+    pub fn wclap_set_input_event_budget(maxEvents: u32, maxBytes: u32);
+
+    pub fn wclap_set_memory_locking(mode: ::std::os::raw::c_int);
+
+    pub fn wclap_locked_memory_bytes() -> u64;
+
+    /* skip wclap_set_webview_coalescing() and wclap_set_thread_policy() for now */
 }
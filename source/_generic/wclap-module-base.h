@@ -8,8 +8,13 @@
 #include "wclap/index-lookup.hpp"
 
 #include "../instance.h"
+#include "../thread-policy.h"
+#include "../mapped-file.h"
+#include "../memory-lock.h"
+#include "../config.h"
 
 #include <thread>
+#include <condition_variable>
 
 namespace WCLAP_BRIDGE_NAMESPACE {
 
@@ -31,6 +36,7 @@ struct WclapModuleBase {
 	std::string errorMessage = "not initialised";
 	std::mutex errorMutex;
 	void setError(const std::string &error) {
+		if (InstanceGroup::redirectError(error.c_str())) return; // preparing an optional `Instance`
 		std::lock_guard<std::mutex> lock{errorMutex};
 		hasError = true;
 		errorMessage = error;
@@ -50,6 +56,34 @@ struct WclapModuleBase {
 		return true;
 	}
 	
+	bool isolatedChild = false; // created just for a single isolated plugin, so doesn't isolate any further
+	std::atomic<size_t> livePluginCount = 0; // created and not yet destroyed
+	// Optional: called (on the thread destroying it) once the last plugin is destroyed, after which this module might be deleted
+	void (*lastPluginDestroyed)(void *context, WclapModuleBase &module) = nullptr;
+	void *lastPluginDestroyedContext = nullptr;
+
+	// For `WCLAP_MEMORY_LOCK_ALL`: the whole memory stays locked while any plugin is active
+	std::mutex memoryLockMutex;
+	size_t memoryLockUsers = 0;
+	std::unique_ptr<wclap_bridge::LockedRange> wholeMemoryLock;
+	void lockWholeMemory() {
+		std::lock_guard<std::mutex> lock{memoryLockMutex};
+		if (memoryLockUsers++) return;
+		uint64_t memorySize;
+		auto *base = mainThread->memoryView(memorySize);
+		wholeMemoryLock = std::make_unique<wclap_bridge::LockedRange>(base, size_t(memorySize));
+	}
+	void unlockWholeMemory() {
+		std::lock_guard<std::mutex> lock{memoryLockMutex};
+		if (!memoryLockUsers || --memoryLockUsers) return;
+		wholeMemoryLock = nullptr;
+	}
+
+	// Set by `WclapModule`: an extra `Instance` with the host functions registered, or `nullptr` (without erroring the module)
+	std::unique_ptr<Instance> (*prepareExtraInstance)(WclapModuleBase &module, std::string &failure) = nullptr;
+
+	wclap_bridge::MappedFileCache resourceCache{wclap_bridge::webviewResourceCacheSize}; // `/plugin.wclap/` files served to webviews, shared by all plugins
+
 	clap_version clapVersion = {0, 0, 0};
 	Pointer<const wclap_plugin_entry> entryPtr;
 
@@ -149,7 +183,7 @@ struct WclapModuleBase {
 		uint32_t index;
 		uint64_t threadArg;
 		
-		std::thread thread;
+		std::thread thread; // not joinable if this is running on a pool worker, which owns its own OS thread
 		std::unique_ptr<Instance> instance;
 		
 		~Thread() {
@@ -165,7 +199,8 @@ struct WclapModuleBase {
 		return std::lock_guard<std::mutex>{threadMutex};
 	}
 	std::vector<std::unique_ptr<Thread>> threads;
-	static void runThread(WclapModuleBase *module, size_t index) {
+	// Returns `false` if the thread's scheduling couldn't be put back, so it shouldn't be reused
+	static bool runThread(WclapModuleBase *module, size_t index) {
 		Thread *thread;
 		{
 			auto lock = module->threadLock();
@@ -174,14 +209,20 @@ struct WclapModuleBase {
 		
 		LOG_EXPR("WCLAP thread starting");
 		
-		thread->instance->runThread(thread->index, thread->threadArg);
+		bool restored;
+		{
+			wclap_bridge::ThreadPolicyScope policy{thread->index};
+			thread->instance->runThread(thread->index, thread->threadArg);
+			restored = policy.restore();
+		}
 
 		// Remove ourselves from the thread list
 		LOG_EXPR("WCLAP thread finished");
 		auto lock = module->threadLock();
-		thread->thread.detach(); // this is the thread running this function, so calling `.join()` from here would break, but we're about to finish anyway
+		if (thread->thread.joinable()) thread->thread.detach(); // this is the thread running this function, so calling `.join()` from here would break, but we're about to finish anyway
 		// The thread vector doesn't get destroyed until all the threads have stopped, so this is safe
 		module->threads[index] = nullptr;
+		return restored;
 	}
 };
 
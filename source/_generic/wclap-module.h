@@ -32,6 +32,9 @@ struct WclapModule : public WclapModuleBase {
 		
 		instanceGroup->wasiThreadSpawnContext = this;
 		instanceGroup->wasiThreadSpawn = staticWasiThreadSpawn;
+		prepareExtraInstance = [](WclapModuleBase &base, std::string &failure) {
+			return static_cast<WclapModule &>(base).prepareOptionalInstance(failure);
+		};
 
 		mainThread->init();
 		if constexpr (WCLAP_BRIDGE_IS64) {
@@ -51,18 +54,70 @@ struct WclapModule : public WclapModuleBase {
 		auto version = mainThread->get(entryPtr[&wclap_plugin_entry::clap_version]);
 		clapVersion = {version.major, version.minor, version.revision};
 
-		if (!mainThread->call(entryPtr[&wclap_plugin_entry::init], pathStr)) {
+		if (instanceGroup->startedFromSnapshot) {
+			// The memory we restored is already post-`clap_entry::init()`
+		} else if (!mainThread->call(entryPtr[&wclap_plugin_entry::init], pathStr)) {
 			setError("clap_entry::init() returned false");
 			return;
+		} else if (wclap_bridge::snapshotAfterInit && !instanceGroup->isThreaded() && !instanceGroup->snapshot) {
+			if (!mainThread->takeSnapshot()) std::cerr << "WCLAP: couldn't snapshot after clap_entry::init()\n";
 		}
 		
+		if (instanceGroup->isThreaded()) startThreadPool(wclap_bridge::wasiThreadPoolSize);
+		
 		hasError = false;
 	}
 	~WclapModule() {
-		// Prevent any new threads from spawning after this point
-		auto lock = this->threadLock();
-		instanceGroup->wasiThreadSpawn = nullptr;
-		instanceGroup->wasiThreadSpawnContext = nullptr;
+		{
+			// Prevent any new threads from spawning after this point
+			auto lock = this->threadLock();
+			instanceGroup->wasiThreadSpawn = nullptr;
+			instanceGroup->wasiThreadSpawnContext = nullptr;
+
+			threadPoolStopping = true;
+			for (auto &thread : threads) {
+				if (thread) thread->instance->requestStop();
+			}
+		}
+		threadPoolCondition.notify_all();
+		for (auto &worker : threadPool) worker->thread.join();
+	}
+
+	// Single-threaded WCLAPs can only run one call at once, so (optionally) each plugin gets its own copy of the module, sharing only the compiled code
+	std::mutex isolatedMutex;
+	std::vector<std::unique_ptr<WclapModule>> isolatedModules;
+	clap_plugin * createIsolatedPlugin(const clap_host *host, const char *pluginId, const clap_plugin_descriptor *desc) {
+		std::lock_guard<std::mutex> lock{isolatedMutex};
+		auto *group = instanceGroup->isolatedCopy();
+		if (!group) return nullptr;
+		std::unique_ptr<WclapModule> child{new WclapModule(group)};
+		char errorMessage[256];
+		if (child->getError(errorMessage, sizeof(errorMessage))) {
+			std::cerr << "WCLAP: failed to start isolated instance: " << errorMessage << std::endl;
+			return nullptr;
+		}
+		child->isolatedChild = true;
+		if (!child->getFactory(CLAP_PLUGIN_FACTORY_ID)) return nullptr;
+
+		auto *plugin = child->pluginFactory->createPlugin(host, pluginId);
+		if (!plugin) return nullptr;
+		plugin->desc = desc; // the host should see the descriptor from the factory it actually called
+		// Free the child's store and memory as soon as its plugin is destroyed
+		child->lastPluginDestroyed = isolatedPluginDestroyed;
+		child->lastPluginDestroyedContext = this;
+		isolatedModules.emplace_back(std::move(child));
+		return plugin;
+	}
+	static void isolatedPluginDestroyed(void *context, WclapModuleBase &child) {
+		auto &self = *(WclapModule *)context;
+		std::unique_ptr<WclapModule> removed; // deleted after unlocking
+		std::lock_guard<std::mutex> lock{self.isolatedMutex};
+		for (auto iter = self.isolatedModules.begin(); iter != self.isolatedModules.end(); ++iter) {
+			if (iter->get() != &child) continue;
+			removed = std::move(*iter);
+			self.isolatedModules.erase(iter);
+			break;
+		}
 	}
 
 	std::optional<PluginFactory> pluginFactory;
@@ -217,17 +272,6 @@ struct WclapModule : public WclapModuleBase {
 
 		auto locked = threadLock();
 
-		auto instance = instanceGroup->startInstance();
-		if (!instance) {
-			setError("failed to start instance for new WCLAP thread");
-			return -1;
-		}
-
-		if (!addHostFunctions(instance.get())) {
-			setError("failed to register host functions for new WCLAP thread");
-			return -1;
-		}
-
 		// Use empty thread or start new one
 		size_t index = threads.size();
 		for (size_t i = 1; i < threads.size(); ++i) {
@@ -236,6 +280,25 @@ struct WclapModule : public WclapModuleBase {
 				break;
 			}
 		}
+
+		// Hand it to a parked worker if we have one ready
+		for (auto &worker : threadPool) {
+			if (!worker->instance || worker->startIndex) continue;
+			if (index == threads.size()) threads.emplace_back();
+			threads[index] = std::unique_ptr<Thread>{new Thread{
+				.index=uint32_t(index),
+				.threadArg=threadArg,
+				.thread={},
+				.instance=std::move(worker->instance)
+			}};
+			worker->startIndex = uint32_t(index);
+			threadPoolCondition.notify_all();
+			return index;
+		}
+
+		auto instance = startThreadInstance();
+		if (!instance) return -1;
+
 		if (index == threads.size()) threads.emplace_back();
 		threads[index] = std::unique_ptr<Thread>{new Thread{
 			.index=uint32_t(index),
@@ -246,67 +309,143 @@ struct WclapModule : public WclapModuleBase {
 
 		return index;
 	}
+
+	// Starts an `Instance` with all the host functions registered, or returns `nullptr` (with the reason in `failure`)
+	std::mutex threadInstanceMutex; // `addHostFunctions()` writes to the shared templates, so only one at once
+	std::unique_ptr<Instance> prepareInstance(std::string &failure) {
+		std::lock_guard<std::mutex> lock{threadInstanceMutex};
+		auto instance = instanceGroup->startInstance();
+		if (!instance) {
+			failure = "failed to start instance";
+			return nullptr;
+		}
+		if (!addHostFunctions(instance.get())) {
+			failure = "failed to register host functions";
+			return nullptr;
+		}
+		return instance;
+	}
+	// As above, but the WCLAP keeps working if it fails (the group error is redirected into `failure`)
+	std::unique_ptr<Instance> prepareOptionalInstance(std::string &failure) {
+		std::string groupFailure;
+		std::unique_ptr<Instance> instance;
+		{
+			InstanceGroup::ErrorRedirect redirect{groupFailure};
+			instance = prepareInstance(failure);
+		}
+		if (!groupFailure.empty()) {
+			failure = groupFailure;
+			return nullptr; // half-constructed instances get deleted here
+		}
+		return instance;
+	}
+	// As above, ready to run a WCLAP thread - failure is a module error
+	std::unique_ptr<Instance> startThreadInstance() {
+		std::string failure;
+		auto instance = prepareInstance(failure);
+		if (!instance) setError(failure + " for new WCLAP thread");
+		return instance;
+	}
+
+	// Parked OS threads, each holding a ready-to-go `Instance`, so that `wasi::thread-spawn` doesn't have to instantiate anything or start a thread
+	struct PoolWorker {
+		std::thread thread;
+		std::unique_ptr<Instance> instance; // prepared, but not running yet
+		uint32_t startIndex = 0; // non-zero when there's a WCLAP thread for us to run
+	};
+	std::vector<std::unique_ptr<PoolWorker>> threadPool;
+	std::condition_variable threadPoolCondition; // uses `threadMutex`
+	bool threadPoolStopping = false;
+
+	void startThreadPool(size_t size) {
+		for (size_t i = 0; i < size; ++i) {
+			auto *worker = new PoolWorker;
+			threadPool.emplace_back(worker);
+			worker->thread = std::thread{runPoolWorker, this, worker};
+		}
+	}
+	static void runPoolWorker(WclapModule *module, PoolWorker *worker) {
+		while (true) {
+			// Prepare the next instance while nobody's waiting for us
+			std::string failure;
+			auto instance = module->prepareOptionalInstance(failure);
+
+			std::unique_lock<std::mutex> lock{module->threadMutex};
+			if (module->threadPoolStopping) return;
+			if (!instance) {
+				// Not fatal: this worker just leaves the pool, and `wasiThreadSpawn()` starts instances itself
+				std::cerr << "WCLAP: " << failure << " for thread pool, shrinking it" << std::endl;
+				return;
+			}
+			worker->instance = std::move(instance);
+			module->threadPoolCondition.wait(lock, [&](){
+				return worker->startIndex || module->threadPoolStopping;
+			});
+			if (!worker->startIndex) return;
+			size_t index = worker->startIndex;
+			worker->startIndex = 0;
+			lock.unlock();
+
+			if (!runThread(module, index)) {
+				// e.g. a positive `nice` which we're not allowed to undo, and the next WCLAP thread shouldn't inherit it
+				std::cerr << "WCLAP: couldn't restore scheduling for pooled thread, shrinking thread pool" << std::endl;
+				return;
+			}
+		}
+	}
 	
 	// Host methods
+	// The guest's string is hashed on every call (it could be on the WCLAP's stack, so its address isn't a safe key), and only the result for each known extension is cached
 	static Pointer<const void> hostTemplate_get_extension(void *context, Pointer<const wclap_host> wHost, Pointer<const char> extId) {
 		auto &self = *(WclapModule *)context;
-		auto hostExtStr = self.mainThread->getString(extId, 1024);
 
 		auto *plugin = getPlugin(context, wHost);
 		if (!plugin) return {0};
-		
-		if (hostExtStr == CLAP_EXT_WEBVIEW) {
+
+		auto hostExtStr = self.mainThread->getStringView(extId, 1024);
+		auto extension = wclap_bridge::lookupExtension(hostExtStr.data(), hostExtStr.size());
+		if (extension == wclap_bridge::Extension::unknown) return {0};
+
+		Pointer<const void> result{0};
+		if (plugin->findHostExtension(extension, result)) return result;
+		result = self.hostExtension(plugin, extension);
+		plugin->rememberHostExtension(extension, result);
+		return result;
+	}
+	Pointer<const void> hostExtension(Plugin *plugin, wclap_bridge::Extension extension) {
+		using Extension = wclap_bridge::Extension;
+		if (extension == Extension::unknown) return {0};
+		if (extension == Extension::webview) {
 			// Special-cased because we provide it to the plugin even if the host doesn't
-			return self.hostWebviewPtr.cast<const void>();
+			return hostWebviewPtr.cast<const void>();
 		}
 		
-		const void *nativeHostExt = plugin->host->get_extension(plugin->host, hostExtStr.c_str());
+		const void *nativeHostExt = plugin->host->get_extension(plugin->host, wclap_bridge::extensionId(extension));
 		if (!nativeHostExt) return {0};
 		
-		if (hostExtStr == CLAP_EXT_AMBISONIC) {
-			return self.hostAmbisonicPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_AUDIO_PORTS_CONFIG) {
-			return self.hostAudioPortsConfigPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_AUDIO_PORTS) {
-			return self.hostAudioPortsPtr.cast<const void>();
-		//} else if (hostExtStr == CLAP_EXT_CONTEXT_MENU) {
-		//	return self.hostContextMenuPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_GUI) {
-			return self.hostGuiPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_LATENCY) {
-			return self.hostLatencyPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_LOG) {
-			return self.hostLogPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_NOTE_NAME) {
-			return self.hostNoteNamePtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_NOTE_PORTS) {
-			return self.hostNotePortsPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_PARAMS) {
-			return self.hostParamsPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_PRESET_LOAD) {
-			return self.hostPresetLoadPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_REMOTE_CONTROLS) {
-			return self.hostRemoteControlsPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_STATE) {
-			return self.hostStatePtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_SURROUND) {
-			return self.hostSurroundPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_TAIL) {
-			return self.hostTailPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_THREAD_CHECK) {
-			return self.hostThreadCheckPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_THREAD_POOL) {
-			return self.hostThreadPoolPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_TIMER_SUPPORT) {
-			return self.hostTimerSupportPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_TRACK_INFO) {
-			return self.hostTrackInfoPtr.cast<const void>();
-		} else if (hostExtStr == CLAP_EXT_VOICE_INFO) {
-			return self.hostVoiceInfoPtr.cast<const void>();
+		switch (extension) {
+		case Extension::ambisonic: return hostAmbisonicPtr.cast<const void>();
+		case Extension::audioPortsConfig: return hostAudioPortsConfigPtr.cast<const void>();
+		case Extension::audioPorts: return hostAudioPortsPtr.cast<const void>();
+		//case Extension::contextMenu: return hostContextMenuPtr.cast<const void>();
+		case Extension::gui: return hostGuiPtr.cast<const void>();
+		case Extension::latency: return hostLatencyPtr.cast<const void>();
+		case Extension::log: return hostLogPtr.cast<const void>();
+		case Extension::noteName: return hostNoteNamePtr.cast<const void>();
+		case Extension::notePorts: return hostNotePortsPtr.cast<const void>();
+		case Extension::params: return hostParamsPtr.cast<const void>();
+		case Extension::presetLoad: return hostPresetLoadPtr.cast<const void>();
+		case Extension::remoteControls: return hostRemoteControlsPtr.cast<const void>();
+		case Extension::state: return hostStatePtr.cast<const void>();
+		case Extension::surround: return hostSurroundPtr.cast<const void>();
+		case Extension::tail: return hostTailPtr.cast<const void>();
+		case Extension::threadCheck: return hostThreadCheckPtr.cast<const void>();
+		case Extension::threadPool: return hostThreadPoolPtr.cast<const void>();
+		case Extension::timerSupport: return hostTimerSupportPtr.cast<const void>();
+		case Extension::trackInfo: return hostTrackInfoPtr.cast<const void>();
+		case Extension::voiceInfo: return hostVoiceInfoPtr.cast<const void>();
+		default: return {0}; // plugin-only extensions
 		}
-		// null, no extensions for now
-LOG_EXPR(hostExtStr);
-		return {0};
 	}
 	static void hostTemplate_request_restart(void *context, Pointer<const wclap_host> wHost) {
 		auto *plugin = getPlugin(context, wHost);
@@ -314,11 +453,17 @@ LOG_EXPR(hostExtStr);
 	}
 	static void hostTemplate_request_process(void *context, Pointer<const wclap_host> wHost) {
 		auto *plugin = getPlugin(context, wHost);
-		if (plugin) return plugin->host->request_process(plugin->host);
+		if (plugin) {
+			plugin->requestWake(); // otherwise we'd keep answering `process()` ourselves while it's asleep
+			return plugin->host->request_process(plugin->host);
+		}
 	}
 	static void hostTemplate_request_callback(void *context, Pointer<const wclap_host> wHost) {
 		auto *plugin = getPlugin(context, wHost);
-		if (plugin) return plugin->host->request_callback(plugin->host);
+		if (plugin) {
+			plugin->wclapCallbackRequested = true;
+			return plugin->host->request_callback(plugin->host);
+		}
 	}
 
 	static uint32_t inputEventsTemplate_size(void *context, Pointer<const wclap_input_events> obj) {
@@ -411,8 +556,10 @@ LOG_EXPR(hostExtStr);
 	static void hostLog_log(void *context, Pointer<const wclap_host> wHost, int32_t severity, Pointer<const char> msg) {
 		auto *plugin = getPlugin(context, wHost);
 		if (plugin) {
-			auto msgString = plugin->mainThread->getString(msg, wclap_bridge::maxLogStringLength);
-			return plugin->hostLog->log(plugin->host, severity, msgString.c_str());
+			char msgBuffer[wclap_bridge::maxLogStringBuffer];
+			auto *msgString = plugin->mainThread->getCString(msg, msgBuffer, wclap_bridge::maxLogStringLength);
+			if (!msgString) msgString = ""; // not optional in CLAP, so hosts won't expect null
+			return plugin->hostLog->log(plugin->host, severity, msgString);
 		}
 	}
 
@@ -439,11 +586,19 @@ LOG_EXPR(hostExtStr);
 	Pointer<wclap_host_params> hostParamsPtr;
 	static void hostParams_rescan(void *context, Pointer<const wclap_host> wHost, uint32_t flags) {
 		auto *plugin = getPlugin(context, wHost);
-		if (plugin) return plugin->hostParams->rescan(plugin->host, flags);
+		if (plugin) {
+			if (flags&(CLAP_PARAM_RESCAN_INFO|CLAP_PARAM_RESCAN_ALL)) plugin->invalidateParamInfo();
+			if (flags&CLAP_PARAM_RESCAN_VALUES) plugin->invalidateParamValues();
+			if (flags&CLAP_PARAM_RESCAN_TEXT) plugin->invalidateParamText();
+			return plugin->hostParams->rescan(plugin->host, flags);
+		}
 	}
 	static void hostParams_clear(void *context, Pointer<const wclap_host> wHost, uint32_t paramId, uint32_t flags) {
 		auto *plugin = getPlugin(context, wHost);
-		if (plugin) return plugin->hostParams->clear(plugin->host, paramId, flags);
+		if (plugin) {
+			plugin->invalidateParamInfo();
+			return plugin->hostParams->clear(plugin->host, paramId, flags);
+		}
 	}
 	static void hostParams_request_flush(void *context, Pointer<const wclap_host> wHost) {
 		auto *plugin = getPlugin(context, wHost);
@@ -455,18 +610,23 @@ LOG_EXPR(hostExtStr);
 	static void hostPresetLoad_on_error(void *context, Pointer<const wclap_host> wHost, uint32_t location_kind, Pointer<const char> location, Pointer<const char> load_key, int32_t os_error, Pointer<const char> msg) {
 		auto *plugin = getPlugin(context, wHost);
 		if (plugin) {
-			auto locationString = plugin->mainThread->getString(location, wclap_bridge::maxLogStringLength);
-			auto loadKeyString = plugin->mainThread->getString(load_key, wclap_bridge::maxLogStringLength);
-			auto msgString = plugin->mainThread->getString(msg, wclap_bridge::maxLogStringLength);
-			return plugin->hostPresetLoad->on_error(plugin->host, location_kind, locationString.c_str(), loadKeyString.c_str(), os_error, msgString.c_str());
+			char buffer[wclap_bridge::maxLogStringBuffer]; // one buffer split between the strings, to keep the stack small
+			constexpr size_t part = sizeof(buffer)/3;
+			auto *locationString = plugin->mainThread->getCString(location, buffer, part, wclap_bridge::maxLogStringLength);
+			auto *loadKeyString = plugin->mainThread->getCString(load_key, buffer + part, part, wclap_bridge::maxLogStringLength);
+			auto *msgString = plugin->mainThread->getCString(msg, buffer + 2*part, part, wclap_bridge::maxLogStringLength);
+			if (!msgString) msgString = ""; // only the location and load key are optional
+			return plugin->hostPresetLoad->on_error(plugin->host, location_kind, locationString, loadKeyString, os_error, msgString);
 		}
 	}
 	static void hostPresetLoad_loaded(void *context, Pointer<const wclap_host> wHost, uint32_t location_kind, Pointer<const char> location, Pointer<const char> load_key) {
 		auto *plugin = getPlugin(context, wHost);
 		if (plugin) {
-			auto locationString = plugin->mainThread->getString(location, wclap_bridge::maxLogStringLength);
-			auto loadKeyString = plugin->mainThread->getString(load_key, wclap_bridge::maxLogStringLength);
-			return plugin->hostPresetLoad->loaded(plugin->host, location_kind, locationString.c_str(), loadKeyString.c_str());
+			char buffer[wclap_bridge::maxLogStringBuffer];
+			constexpr size_t part = sizeof(buffer)/2;
+			auto *locationString = plugin->mainThread->getCString(location, buffer, part, wclap_bridge::maxLogStringLength);
+			auto *loadKeyString = plugin->mainThread->getCString(load_key, buffer + part, part, wclap_bridge::maxLogStringLength);
+			return plugin->hostPresetLoad->loaded(plugin->host, location_kind, locationString, loadKeyString);
 		}
 	}
 
@@ -499,7 +659,10 @@ LOG_EXPR(hostExtStr);
 	Pointer<wclap_host_tail> hostTailPtr;
 	static void hostTail_changed(void *context, Pointer<const wclap_host> wHost) {
 		auto *plugin = getPlugin(context, wHost);
-		if (plugin) return plugin->hostTail->changed(plugin->host);
+		if (plugin) {
+			plugin->tailChanged = true;
+			return plugin->hostTail->changed(plugin->host);
+		}
 	}
 
 	wclap_host_thread_check hostThreadCheck;
@@ -584,4 +747,8 @@ LOG_EXPR(hostExtStr);
 	}
 };
 
+inline clap_plugin * PluginFactory::createIsolatedPlugin(const clap_host *host, const char *pluginId, const clap_plugin_descriptor *desc) const {
+	return ((WclapModule &)module).createIsolatedPlugin(host, pluginId, desc);
+}
+
 }; // namespace
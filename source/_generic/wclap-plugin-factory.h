@@ -25,8 +25,11 @@ struct PluginFactory {
 	
 	const char * readString(Pointer<const char> ptr, const char *nullValue=nullptr, const char *prefix="", const char *suffix="") {
 		if (!ptr) return nullValue;
-		auto str = prefix + module.mainThread->getString(ptr, 2048) + suffix;
-		strings.emplace_back(std::unique_ptr<std::string>{new std::string(std::move(str))});
+		auto view = module.mainThread->getStringView(ptr, 2048);
+		auto *str = new std::string();
+		str->reserve(std::strlen(prefix) + view.size() + std::strlen(suffix));
+		str->append(prefix).append(view).append(suffix);
+		strings.emplace_back(std::unique_ptr<std::string>{str});
 		return strings.back()->data();
 	}
 
@@ -41,6 +44,10 @@ LOG_EXPR(pluginId);
 		}
 		if (!desc) return nullptr;
 		
+		if (wclap_bridge::isolatePluginInstances && !module.isolatedChild && !module.instanceGroup->isThreaded()) {
+			return createIsolatedPlugin(host, pluginId, desc);
+		}
+		
 		auto scoped = module.arenaPool.scoped();
 
 		// In order to get to this point, it must've started with the WCLAP prefix (if defined), so skip it
@@ -53,6 +60,9 @@ LOG_EXPR(pluginId);
 		return &plugin->clapPlugin;
 	}
 
+	// Defined after `WclapModule`
+	clap_plugin * createIsolatedPlugin(const clap_host *host, const char *pluginId, const clap_plugin_descriptor *desc) const;
+
 	PluginFactory(WclapModuleBase &module, Pointer<wclap_plugin_factory> ptr) : module(module), ptr(ptr) {
 		auto &instance = *module.mainThread;
 		// Enumerate all the descriptors up-front
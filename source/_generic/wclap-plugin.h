@@ -2,11 +2,19 @@
 
 #include <atomic>
 #include <string_view>
-#include <fstream>
+#include <array>
+#include <algorithm>
+#include <type_traits>
+#include <unordered_map>
 
 #include "webview-gui/clap-webview-gui.h"
 #include "webview-gui/helpers.h"
 
+#include "../extension-ids.h"
+#include "../sample-convert.h"
+#include "../lru-cache.h"
+#include "../message-queue.h"
+
 namespace WCLAP_BRIDGE_NAMESPACE {
 
 using namespace WCLAP_API_NAMESPACE;
@@ -46,9 +54,11 @@ struct Plugin {
 	const clap_host_webview *hostWebview = nullptr;
 		
 	Plugin(WclapModuleBase &module, const clap_host *host, Pointer<wclap_host> hostPtr, Pointer<const wclap_plugin> ptr, MemoryArenaPtr arena, const clap_plugin_descriptor *desc) : module(module), mainThread(module.mainThread.get()), ptr(ptr), arena(std::move(arena)), maybeAudioThread(module.instanceGroup->startInstance()), audioThread(maybeAudioThread ? maybeAudioThread.get() : mainThread), host(host) {
+		resetHostExtensions();
 		// Address using its index in the plugin list (where it's retained)
 		pluginListIndex = module.pluginList.retain(this);
 		module.setPlugin(hostPtr, pluginListIndex);
+		++module.livePluginCount;
 
 		clapPlugin.desc = desc;
 		inputEvents.reserve(1024);
@@ -79,8 +89,22 @@ struct Plugin {
 
 	// Host methods
 	std::recursive_mutex hostEventsMutex;
-	std::vector<Pointer<const wclap_event_header>> inputEvents;
+	std::vector<Pointer<const wclap_event_header>> inputEvents; // capacity reserved at activation
+	size_t inputEventBytesUsed = 0;
+	// Per-block input budget, fixed at activation to match what was reserved
+	size_t inputEventLimit = wclap_bridge::maxInputEvents, inputEventBytesLimit = wclap_bridge::inputEventBytes;
 	const clap_output_events *hostOutputEvents = nullptr;
+	bool outputEventsPushed = false; // since `setHostOutputEvents()`
+	// Sysex data has to stay valid until the end of the process/flush, so it's copied here
+	std::vector<uint8_t> sysexScratch;
+	size_t sysexScratchUsed = 0;
+	std::atomic<uint64_t> sysexOverflows = 0, sysexOverflowBytes = 0;
+	// Must hold `hostEventsMutex`
+	void setHostOutputEvents(const clap_output_events *events) {
+		hostOutputEvents = events;
+		outputEventsPushed = false;
+		sysexScratchUsed = 0;
+	}
 	uint32_t inputEventsSize() {
 		std::unique_lock<std::recursive_mutex> lock{hostEventsMutex};
 		return uint32_t(inputEvents.size());
@@ -92,6 +116,15 @@ struct Plugin {
 	}
 	void tryCopyInputEvent(MemoryArenaScope &scope, const clap_event_header *event) {
 		if (event->space_id != CLAP_CORE_EVENT_SPACE_ID) return;
+		// Stay inside the space reserved at activation, so the arena doesn't grow (with the WCLAP's `malloc()`)
+		size_t eventBytes = size_t(event->size) + 16; // translated events are never bigger than native ones, plus alignment
+		if (event->type == 11) eventBytes += ((const clap_event_midi_sysex *)event)->size + 16;
+		if (inputEvents.size() >= inputEventLimit || inputEventBytesUsed + eventBytes > inputEventBytesLimit) {
+			++droppedInputEvents;
+			requestOverflowReport();
+			return;
+		}
+		inputEventBytesUsed += eventBytes;
 		if (event->type <= 4 || (event->type >= 7 && event->type <= 10) || event->type == 12) {
 			// clap_event_note, clap_event_note_expression, clap_event_param_gesture, clap_event_transport, clap_event_midi or clap_event_midi2
 			auto bytes = scope.reserve(event->size, 8).cast<unsigned char>();
@@ -114,6 +147,7 @@ struct Plugin {
 			};
 			Pointer<wclap_event_param_value> wValueEventPtr = scope.copyAcross(wValueEvent);
 			inputEvents.push_back(wValueEventPtr.cast<const wclap_event_header>());
+			if (event->type == 5) observeParamValue(valueEvent);
 		} else if (event->type == 11) {
 			auto *sysex = (clap_event_midi_sysex *)event;
 			auto size = sysex->size;
@@ -132,6 +166,7 @@ struct Plugin {
 	bool outputEventsTryPush(Pointer<const wclap_event_header> event) {
 		std::unique_lock<std::recursive_mutex> lock{hostEventsMutex};
 		if (!hostOutputEvents) return false;
+		outputEventsPushed = true;
 		auto eventHeader = audioThread->get(event);
 		if (eventHeader.space_id != CLAP_CORE_EVENT_SPACE_ID) return false;
 
@@ -166,6 +201,7 @@ struct Plugin {
 				.value=wEvent.value
 			};
 			nativeEvent.header.size = sizeof(nativeEvent);
+			if (eventHeader.type == 5) observeParamValue(nativeEvent);
 			return hostOutputEvents->try_push(hostOutputEvents, &nativeEvent.header);
 		} else if (eventHeader.type == 7 || eventHeader.type == 8) {
 			clap_event_param_gesture nativeEvent;
@@ -184,9 +220,16 @@ struct Plugin {
 			return hostOutputEvents->try_push(hostOutputEvents, &nativeEvent.header);
 		} else if (eventHeader.type == 11) {
 			auto wEvent = audioThread->get(event.cast<const wclap_event_midi_sysex>());
-			if (wEvent.size > 1024) return false; // too big, and we don't want to allocate here
-			uint8_t buffer[1024];
+			if (wEvent.size > sysexScratch.size() - sysexScratchUsed) {
+				// Too big, and we don't want to allocate here
+				++sysexOverflows;
+				sysexOverflowBytes += wEvent.size;
+				requestOverflowReport();
+				return false;
+			}
+			auto *buffer = sysexScratch.data() + sysexScratchUsed;
 			audioThread->getArray(wEvent.buffer, buffer, wEvent.size);
+			sysexScratchUsed += wEvent.size;
 			clap_event_midi_sysex nativeEvent{
 				.header=*(clap_event_header *)&wEvent.header,
 				.port_index=wEvent.port_index,
@@ -204,37 +247,86 @@ struct Plugin {
 		return false;
 	}
 
+	// What `host.get_extension()` returns for each known extension, looked up from the native host on first use.  Lock-free, because it's also called from the audio thread.
+	using HostExtensionValue = decltype(Pointer<const void>{0}.wasmPointer);
+	static constexpr HostExtensionValue hostExtensionUnresolved = HostExtensionValue(-1);
+	std::array<std::atomic<HostExtensionValue>, wclap_bridge::extensionCount> hostExtensions;
+	void resetHostExtensions() {
+		for (auto &entry : hostExtensions) entry.store(hostExtensionUnresolved, std::memory_order_relaxed);
+	}
+	bool findHostExtension(wclap_bridge::Extension extension, Pointer<const void> &result) {
+		auto value = hostExtensions[size_t(extension)].load(std::memory_order_relaxed);
+		if (value == hostExtensionUnresolved) return false;
+		result = {value};
+		return true;
+	}
+	void rememberHostExtension(wclap_bridge::Extension extension, Pointer<const void> result) {
+		// Racing lookups get the same answer, so it doesn't matter which store wins
+		hostExtensions[size_t(extension)].store(result.wasmPointer, std::memory_order_relaxed);
+	}
+
 	std::recursive_mutex hostStreamsMutex;
 	const clap_istream *hostIstream = nullptr;
 	const clap_ostream *hostOstream = nullptr;
+	Instance *streamInstance = nullptr; // whichever `Instance` is running the current save/load
+	// No intermediate buffer or chunk limit: the host stream reads/writes WASM memory directly, since it can't run WCLAP code (and move the memory) in the meantime
 	int64_t istreamRead(Pointer<void> buffer, uint64_t size) {
 		std::unique_lock<std::recursive_mutex> lock{hostStreamsMutex};
 		if (!hostIstream) return -1;
-		
-		if (size > 1024) size = 1024; // 1kB max
-		unsigned char localBuffer[1024];
-		auto result = hostIstream->read(hostIstream, localBuffer, size);
-		if (result > 0 && result <= 1024) {
-			mainThread->setArray(buffer.cast<unsigned char>(), localBuffer, result);
-		}
-		return result;
+		if (!size) return 0;
+
+		auto *wasmBuffer = (streamInstance ? streamInstance : mainThread)->view(buffer.cast<unsigned char>(), size);
+		if (!wasmBuffer) return -1;
+		return hostIstream->read(hostIstream, wasmBuffer, size);
 	}
 	int64_t ostreamWrite(Pointer<const void> buffer, uint64_t size) {
 		std::unique_lock<std::recursive_mutex> lock{hostStreamsMutex};
 		if (!hostOstream) return -1;
-		
-		if (size > 1024) size = 1024; // 1kB max
-		unsigned char localBuffer[1024];
-		mainThread->getArray(buffer.cast<unsigned char>(), localBuffer, size);
-		return hostOstream->write(hostOstream, localBuffer, size);
-	}
-	std::mutex webviewMessageMutex;
-	std::vector<unsigned char> webviewMessageBuffer;
-	bool webviewSend(Pointer<const void> buffer, uint64_t size) {
-		std::unique_lock<std::mutex> lock{webviewMessageMutex};
-		webviewMessageBuffer.resize(size); // main thread, it's fine
-		mainThread->getArray(buffer.cast<unsigned char>(), webviewMessageBuffer.data(), size);
-		return hostWebview->send(host, webviewMessageBuffer.data(), size);
+		if (!size) return 0;
+
+		auto *wasmBuffer = (streamInstance ? streamInstance : mainThread)->view(buffer.cast<const unsigned char>(), size);
+		if (!wasmBuffer) return -1;
+		return hostOstream->write(hostOstream, wasmBuffer, size);
+	}
+
+	// Webview messages are queued in both directions, and delivered in batches from `on_main_thread()`
+	wclap_bridge::MessageChannel webviewToHost{wclap_bridge::webviewQueueBytes, wclap_bridge::webviewQueueMessages};
+	wclap_bridge::MessageChannel webviewToWclap{wclap_bridge::webviewQueueBytes, wclap_bridge::webviewQueueMessages};
+	uint64_t (*webviewCoalesceKey)(void *, const void *, uint32_t, bool) = wclap_bridge::webviewCoalesceKey;
+	void *webviewCoalesceContext = wclap_bridge::webviewCoalesceContext;
+	std::atomic<bool> wclapCallbackRequested = false; // so the WCLAP's `on_main_thread()` is only called when it asked
+
+	bool queueWebviewMessage(wclap_bridge::MessageChannel &channel, const void *data, uint32_t size, bool toWclap) {
+		uint64_t key = webviewCoalesceKey ? webviewCoalesceKey(webviewCoalesceContext, data, size, toWclap) : 0;
+		bool wasEmpty;
+		if (!channel.push(data, size, key, wasEmpty)) return false;
+		if (wasEmpty) host->request_callback(host);
+		return true;
+	}
+	bool webviewSend(Pointer<const void> buffer, uint32_t size) {
+		auto *data = mainThread->view(buffer.cast<const unsigned char>(), size);
+		if (!data || !hostWebview) return false;
+		if (queueWebviewMessage(webviewToHost, data, size, false)) return true;
+		// Too big (or too many) to queue, so deliver it now - but after what's already queued, to keep them in order
+		drainWebviewToHost();
+		return hostWebview->send(host, data, size);
+	}
+	void drainWebviewMessages() {
+		drainWebviewToHost();
+		drainWebviewToWclap();
+	}
+	void drainWebviewToHost() {
+		webviewToHost.drain([&](const void *data, uint32_t size) {
+			if (hostWebview) hostWebview->send(host, data, size);
+		});
+	}
+	void drainWebviewToWclap() {
+		auto scoped = module.arenaPool.scoped(); // one scope for the whole batch
+		webviewToWclap.drain([&](const void *data, uint32_t size) {
+			auto bufferPtr = scoped.array<unsigned char>(size);
+			mainThread->setArray(bufferPtr, (const unsigned char *)data, size);
+			mainThread->call(webviewExt[&wclap_plugin_webview::receive], ptr, bufferPtr.cast<const void>(), size);
+		});
 	}
 private:
 
@@ -272,24 +364,412 @@ private:
 	void pluginDestroy() {
 		mainThread->call(ptr[&wclap_plugin::destroy], ptr);
 		destroyCalled = true;
-		module.pluginList.release(pluginListIndex);
+		{
+			std::unique_lock<std::recursive_mutex> lock{hostStreamsMutex};
+			maybeStateThread = nullptr;
+		}
+		auto &pluginModule = module; // releasing deletes us
+		pluginModule.pluginList.release(pluginListIndex);
+		if (--pluginModule.livePluginCount == 0 && pluginModule.lastPluginDestroyed) {
+			pluginModule.lastPluginDestroyed(pluginModule.lastPluginDestroyedContext, pluginModule);
+		}
 	}
 	bool pluginActivate(double sRate, uint32_t minFrames, uint32_t maxFrames) {
-		return audioThread->call(ptr[&wclap_plugin::activate], ptr, sRate, minFrames, maxFrames);
+		if (!audioThread->call(ptr[&wclap_plugin::activate], ptr, sRate, minFrames, maxFrames)) return false;
+		{
+			std::unique_lock<std::recursive_mutex> lock{hostEventsMutex};
+			sysexScratch.resize(wclap_bridge::maxSysexBytes);
+			sysexScratchUsed = 0;
+		}
+		activeInputs = wclapPorts(true);
+		activeOutputs = wclapPorts(false);
+		memoryLockMode = wclap_bridge::memoryLockMode;
+		if (memoryLockMode == WCLAP_MEMORY_LOCK_ALL) module.lockWholeMemory();
+		startResident(maxFrames);
+		reserveAudioArena(maxFrames);
+		if (!tailExt) tailExt = wclapGetExtension(CLAP_EXT_TAIL).cast<const wclap_plugin_tail>();
+		tailChanged = true;
+		wake();
+		return true;
 	}
 	void pluginDeactivate() {
 		audioThread->call(ptr[&wclap_plugin::deactivate], ptr);
+		stopResident();
+		lockedAudioMemory.clear();
+		if (memoryLockMode == WCLAP_MEMORY_LOCK_ALL) module.unlockWholeMemory();
+		memoryLockMode = WCLAP_MEMORY_LOCK_NONE;
+		reportOverflows();
+	}
+	void logWarning(const std::string &message) {
+		if (hostLog) {
+			hostLog->log(host, CLAP_LOG_WARNING, message.c_str());
+		} else {
+			std::cerr << "WCLAP: " << message << std::endl;
+		}
+	}
+	// Anything dropped on the audio thread is logged from the next `on_main_thread()`, since we can't build the message there
+	std::atomic<bool> overflowReportRequested = false;
+	void requestOverflowReport() {
+		if (!overflowReportRequested.exchange(true)) host->request_callback(host);
+	}
+	void reportOverflows() {
+		overflowReportRequested = false;
+		if (auto overflows = sysexOverflows.exchange(0)) {
+			auto bytes = sysexOverflowBytes.exchange(0);
+			logWarning("dropped " + std::to_string(overflows) + " sysex output event(s) (" + std::to_string(bytes) + " bytes) which didn't fit in the " + std::to_string(sysexScratch.size()) + "-byte sysex buffer");
+		}
+		if (auto dropped = droppedInputEvents.exchange(0)) {
+			logWarning("dropped " + std::to_string(dropped) + " input event(s) beyond the per-block budget (" + std::to_string(inputEventLimit) + " events / " + std::to_string(inputEventBytesLimit) + " bytes)");
+		}
+		if (auto overflows = audioArenaOverflows.exchange(0)) {
+			logWarning("failed " + std::to_string(overflows) + " block(s) whose audio buffers didn't fit in the space reserved at activation");
+		}
+	}
+
+	// Memory the audio thread uses, prefaulted and locked from activate to deactivate (if enabled)
+	uint32_t memoryLockMode = WCLAP_MEMORY_LOCK_NONE; // what we did at activation
+	std::vector<wclap_bridge::LockedRange> lockedAudioMemory;
+	void lockAudioMemory(uint64_t wasmP, size_t bytes) {
+		if (memoryLockMode == WCLAP_MEMORY_LOCK_NONE) return;
+		if (auto *hostP = audioThread->memoryRange(wasmP, bytes)) {
+			lockedAudioMemory.emplace_back(hostP, bytes);
+		}
+	}
+
+	// The audio-thread arena is sized at activation, so it never needs to grow (calling the WCLAP's `malloc()`) while processing
+	size_t audioBlockBytes = 0; // space for `processBlock()`'s buffers, for the port layout at activation
+	std::atomic<uint64_t> droppedInputEvents = 0, audioArenaOverflows = 0;
+	static size_t blockBytes(size_t channels, size_t ports, size_t frames) {
+		// 32- and 64-bit copies of each channel, channel pointers (for both), the buffer structs, and alignment
+		return channels*(frames*(sizeof(float) + sizeof(double)) + 2*sizeof(Pointer<float>) + 32) + ports*(sizeof(wclap_audio_buffer) + 16);
+	}
+	void reserveAudioArena(uint32_t maxFrames) {
+		size_t channels = 0;
+		for (auto &port : activeInputs) channels += port.channelCount;
+		for (auto &port : activeOutputs) channels += port.channelCount;
+		audioBlockBytes = blockBytes(channels, activeInputs.size() + activeOutputs.size(), maxFrames);
+		auto fixedBytes = 2*sizeof(module.inputEventsTemplate) + sizeof(wclap_process) + sizeof(wclap_event_transport) + 256;
+		{
+			std::unique_lock<std::recursive_mutex> lock{hostEventsMutex};
+			inputEventLimit = wclap_bridge::maxInputEvents;
+			inputEventBytesLimit = wclap_bridge::inputEventBytes;
+			inputEvents.reserve(inputEventLimit);
+		}
+		// Grow the arena once now (on the main thread), and it keeps that capacity for later scopes
+		auto scoped = arena->scoped();
+		auto reservedBytes = audioBlockBytes + inputEventBytesLimit + fixedBytes;
+		auto reserved = scoped.reserve(reservedBytes, 16);
+		lockAudioMemory(uint64_t(reserved.wasmPointer), reservedBytes);
+	}
+	// Checks the host's buffers fit in what we reserved
+	bool blockFitsArena(const clap_process *process) {
+		if (!audioBlockBytes) return true; // not sized yet
+		size_t channels = 0;
+		for (uint32_t i = 0; i < process->audio_inputs_count; ++i) channels += process->audio_inputs[i].channel_count;
+		for (uint32_t i = 0; i < process->audio_outputs_count; ++i) channels += process->audio_outputs[i].channel_count;
+		return blockBytes(channels, process->audio_inputs_count + process->audio_outputs_count, process->frames_count) <= audioBlockBytes;
 	}
 	bool pluginStartProcessing() {
+		wake();
 		return audioThread->call(ptr[&wclap_plugin::start_processing], ptr);
 	}
 	void pluginStopProcessing() {
 		audioThread->call(ptr[&wclap_plugin::stop_processing], ptr);
 	}
 	void pluginReset() {
+		wake();
 		audioThread->call(ptr[&wclap_plugin::reset], ptr);
 	}
+
+	// Sleep/bypass: once the WCLAP says it can sleep, and nothing arrives to wake it, we answer `process()` ourselves
+	clap_process_status lastStatus = CLAP_PROCESS_CONTINUE;
+	bool lastOutputQuiet = false;
+	uint64_t quietInputFrames = 0; // how long it's been since there was input, for `CLAP_PROCESS_TAIL`
+	uint32_t tailFrames = 0;
+	std::atomic<bool> tailChanged = true;
+	void wake() {
+		lastStatus = CLAP_PROCESS_CONTINUE;
+		lastOutputQuiet = false;
+		quietInputFrames = 0;
+	}
+	// From any thread (e.g. the WCLAP's `request_process()`), picked up by the next `process()`
+	std::atomic<bool> wakeRequested = false;
+	void requestWake() {
+		wakeRequested = true;
+	}
+	bool canSleep() {
+		switch (lastStatus) {
+		case CLAP_PROCESS_SLEEP:
+			return true;
+		case CLAP_PROCESS_CONTINUE_IF_NOT_QUIET:
+			return lastOutputQuiet;
+		case CLAP_PROCESS_TAIL:
+			if (tailChanged.exchange(false)) {
+				tailFrames = tailExt ? audioThread->call(tailExt[&wclap_plugin_tail::get], ptr) : 0;
+			}
+			return tailFrames != UINT32_MAX && quietInputFrames >= tailFrames;
+		default:
+			return false;
+		}
+	}
+	template<class S>
+	static bool channelQuiet(const S *channel, uint32_t frames, bool constant) {
+		if (constant) return !frames || channel[0] == 0;
+		for (uint32_t i = 0; i < frames; ++i) {
+			if (channel[i] != 0) return false;
+		}
+		return true;
+	}
+	static bool buffersQuiet(const clap_audio_buffer *buffers, uint32_t count, uint32_t frames) {
+		for (uint32_t portIndex = 0; portIndex < count; ++portIndex) {
+			auto &buffer = buffers[portIndex];
+			for (uint32_t c = 0; c < buffer.channel_count; ++c) {
+				bool constant = isConstant(buffer.constant_mask, c);
+				if (buffer.data32 && !channelQuiet(buffer.data32[c], frames, constant)) return false;
+				if (!buffer.data32 && buffer.data64 && !channelQuiet(buffer.data64[c], frames, constant)) return false;
+			}
+		}
+		return true;
+	}
+	clap_process_status processAsleep(const clap_process *process) {
+		silenceOutputs(process);
+		return CLAP_PROCESS_SLEEP;
+	}
+	// The masks written here are only for the host: `processBlock()`/`processResident()` never pass the host's output masks on to the WCLAP
+	static void silenceOutputs(const clap_process *process) {
+		for (uint32_t portIndex = 0; portIndex < process->audio_outputs_count; ++portIndex) {
+			auto &buffer = process->audio_outputs[portIndex];
+			for (uint32_t c = 0; c < buffer.channel_count; ++c) {
+				if (buffer.data32) std::fill_n(buffer.data32[c], process->frames_count, 0.0f);
+				if (buffer.data64) std::fill_n(buffer.data64[c], process->frames_count, 0.0);
+			}
+			buffer.constant_mask = (buffer.channel_count >= 64) ? ~uint64_t(0) : (uint64_t(1) << buffer.channel_count) - 1;
+		}
+	}
+	// Copy across (a recognised/translatable subset of) input events - must hold `hostEventsMutex`
+	void copyInputEvents(MemoryArenaScope &scoped, const clap_input_events *eventsIn) {
+		inputEvents.resize(0);
+		inputEventBytesUsed = 0;
+		uint32_t count = eventsIn->size(eventsIn);
+		for (uint32_t i = 0; i < count; ++i) {
+			tryCopyInputEvent(scoped, eventsIn->get(eventsIn, i));
+		}
+	}
+
+	// Structures which live in WASM memory from activate to deactivate, so each block only patches the fields which change
+	struct ResidentPort {
+		uint32_t channelCount;
+		Pointer<Pointer<float>> channels;
+		Pointer<float> block; // channels are `maxFrames` apart
+		wclap_audio_buffer buffer; // what's currently in WASM memory
+	};
+	struct Resident {
+		MemoryArenaPtr arena;
+		uint32_t maxFrames;
+		Pointer<wclap_input_events> inEvents;
+		Pointer<wclap_output_events> outEvents;
+		Pointer<wclap_event_transport> transport;
+		Pointer<wclap_audio_buffer> audioInputs, audioOutputs;
+		std::vector<ResidentPort> inputs, outputs;
+		Pointer<wclap_process> process;
+		wclap_process processState; // what's currently in WASM memory
+	};
+	std::optional<Resident> resident;
+
+	Pointer<const void> wclapGetExtension(const char *extId) {
+		auto scoped = module.arenaPool.scoped();
+		auto extIdPtr = scoped.writeString(extId);
+		return mainThread->call(ptr[&wclap_plugin::get_extension], ptr, extIdPtr);
+	}
+	struct WclapPort {
+		uint32_t channelCount;
+		bool supports64;
+	};
+	std::vector<WclapPort> wclapPorts(bool isInput) {
+		std::vector<WclapPort> ports;
+		auto ext = wclapGetExtension(CLAP_EXT_AUDIO_PORTS).cast<const wclap_plugin_audio_ports>();
+		if (!ext) return ports;
+		auto scoped = module.arenaPool.scoped();
+		auto infoPtr = scoped.reserveBlank<wclap_audio_port_info>();
+		auto count = mainThread->call(ext[&wclap_plugin_audio_ports::count], ptr, isInput);
+		for (uint32_t i = 0; i < count; ++i) {
+			if (!mainThread->call(ext[&wclap_plugin_audio_ports::get], ptr, i, isInput, infoPtr)) return {};
+			auto info = mainThread->get(infoPtr);
+			ports.push_back({info.channel_count, bool(info.flags&CLAP_AUDIO_PORT_SUPPORTS_64BITS)});
+		}
+		return ports;
+	}
+	// We tell the host every port supports 64-bit, and convert if the WCLAP doesn't
+	std::vector<WclapPort> activeInputs, activeOutputs;
+	bool wclapSupports64(bool isInput, uint32_t portIndex) const {
+		auto &ports = isInput ? activeInputs : activeOutputs;
+		return portIndex < ports.size() && ports[portIndex].supports64;
+	}
+	void startResident(uint32_t maxFrames) {
+		stopResident();
+
+		auto scoped = module.arenaPool.scoped();
+		Resident r;
+		r.maxFrames = maxFrames;
+		r.inEvents = scoped.copyAcross(module.inputEventsTemplate);
+		r.outEvents = scoped.copyAcross(module.outputEventsTemplate);
+		module.setPlugin(r.inEvents, pluginListIndex);
+		module.setPlugin(r.outEvents, pluginListIndex);
+		r.transport = scoped.reserveBlank<wclap_event_transport>();
+
+		auto addPorts = [&](const std::vector<WclapPort> &wclapPorts, std::vector<ResidentPort> &ports, Pointer<wclap_audio_buffer> &buffers) {
+			buffers = scoped.array<wclap_audio_buffer>(wclapPorts.size());
+			for (size_t i = 0; i < wclapPorts.size(); ++i) {
+				ResidentPort port{.channelCount=wclapPorts[i].channelCount};
+				port.channels = scoped.array<Pointer<float>>(port.channelCount);
+				port.block = scoped.array<float>(size_t(port.channelCount)*maxFrames);
+				for (uint32_t c = 0; c < port.channelCount; ++c) {
+					audioThread->set(port.channels, port.block + c*maxFrames, c);
+				}
+				port.buffer = {
+					.data32=port.channels,
+					.data64={0},
+					.channel_count=port.channelCount,
+					.latency=0,
+					.constant_mask=0
+				};
+				audioThread->set(buffers, port.buffer, i);
+				ports.push_back(port);
+			}
+		};
+		addPorts(activeInputs, r.inputs, r.audioInputs);
+		addPorts(activeOutputs, r.outputs, r.audioOutputs);
+
+		r.processState = {
+			.steady_time=-1,
+			.frames_count=0,
+			.transport={0},
+			.audio_inputs=r.audioInputs.cast<const wclap_audio_buffer>(),
+			.audio_outputs=r.audioOutputs,
+			.audio_inputs_count=uint32_t(r.inputs.size()),
+			.audio_outputs_count=uint32_t(r.outputs.size()),
+			.in_events=r.inEvents,
+			.out_events=r.outEvents
+		};
+		r.process = scoped.copyAcross(r.processState);
+		r.arena = scoped.commit();
+		lockAudioMemory(uint64_t(r.process.wasmPointer), sizeof(wclap_process));
+		for (auto *ports : {&r.inputs, &r.outputs}) {
+			for (auto &port : *ports) lockAudioMemory(uint64_t(port.block.wasmPointer), sizeof(float)*port.channelCount*maxFrames);
+		}
+		resident.emplace(std::move(r));
+	}
+	void stopResident() {
+		if (!resident) return;
+		resident->arena->pool.returnToPool(resident->arena);
+		resident.reset();
+	}
+	// The host's buffers have to match what we allocated, otherwise we use the per-block path
+	bool residentMatches(const clap_process *process) const {
+		auto &r = *resident;
+		if (process->frames_count > r.maxFrames) return false;
+		if (process->audio_inputs_count != r.inputs.size() || process->audio_outputs_count != r.outputs.size()) return false;
+		// Resident buffers are 32-bit, which is fine for 64-bit host buffers only if we'd be converting anyway
+		auto portsMatch = [&](const clap_audio_buffer *buffers, const std::vector<ResidentPort> &ports, bool isInput) {
+			for (uint32_t i = 0; i < ports.size(); ++i) {
+				if (buffers[i].channel_count != ports[i].channelCount) return false;
+				if (!buffers[i].data32 && (!buffers[i].data64 || wclapSupports64(isInput, i))) return false;
+			}
+			return true;
+		};
+		return portsMatch(process->audio_inputs, r.inputs, true) && portsMatch(process->audio_outputs, r.outputs, false);
+	}
+	clap_process_status processResident(const clap_process *process) {
+		auto &r = *resident;
+		auto scoped = arena->scoped(); // events still go in the audio-thread arena
+
+		std::unique_lock<std::recursive_mutex> lock{hostEventsMutex};
+		copyInputEvents(scoped, process->in_events);
+		setHostOutputEvents(process->out_events);
+
+		auto &state = r.processState;
+		if (state.steady_time != process->steady_time) {
+			state.steady_time = process->steady_time;
+			audioThread->set(r.process[&wclap_process::steady_time], state.steady_time);
+		}
+		if (state.frames_count != process->frames_count) {
+			state.frames_count = process->frames_count;
+			audioThread->set(r.process[&wclap_process::frames_count], state.frames_count);
+		}
+		Pointer<const wclap_event_transport> transport{0};
+		if (process->transport) {
+			// The transport event contains no pointers, so translates directly.
+			audioThread->set(r.transport, *(const wclap_event_transport *)process->transport);
+			transport = r.transport.cast<const wclap_event_transport>();
+		}
+		if (state.transport.wasmPointer != transport.wasmPointer) {
+			state.transport = transport;
+			audioThread->set(r.process[&wclap_process::transport], state.transport);
+		}
+
+		auto updatePort = [&](const clap_audio_buffer &buffer, ResidentPort &port, Pointer<wclap_audio_buffer> portPtr, uint64_t constantMask) {
+			if (port.buffer.latency != buffer.latency) {
+				port.buffer.latency = buffer.latency;
+				audioThread->set(portPtr[&wclap_audio_buffer::latency], port.buffer.latency);
+			}
+			if (port.buffer.constant_mask != constantMask) {
+				port.buffer.constant_mask = constantMask;
+				audioThread->set(portPtr[&wclap_audio_buffer::constant_mask], port.buffer.constant_mask);
+			}
+		};
+		for (uint32_t portIndex = 0; portIndex < r.inputs.size(); ++portIndex) {
+			auto &buffer = process->audio_inputs[portIndex];
+			auto &port = r.inputs[portIndex];
+			updatePort(buffer, port, r.audioInputs + portIndex, buffer.constant_mask);
+			if (buffer.data32) {
+				copyChannelsIn<float>(port.block, buffer.data32, port.channelCount, process->frames_count, r.maxFrames, buffer.constant_mask);
+			} else {
+				copyChannelsIn<float>(port.block, buffer.data64, port.channelCount, process->frames_count, r.maxFrames, buffer.constant_mask);
+			}
+		}
+		for (uint32_t portIndex = 0; portIndex < r.outputs.size(); ++portIndex) {
+			// Output masks start clear, so we only trust bits the WCLAP sets during this call (the host's are whatever we wrote back last time)
+			updatePort(process->audio_outputs[portIndex], r.outputs[portIndex], r.audioOutputs + portIndex, 0);
+		}
+
+		auto resultCode = mainThread->call(ptr[&wclap_plugin::process], ptr, r.process);
+
+		hostOutputEvents = nullptr;
+		for (uint32_t portIndex = 0; portIndex < r.outputs.size(); ++portIndex) {
+			auto &buffer = process->audio_outputs[portIndex];
+			auto &port = r.outputs[portIndex];
+			// The WCLAP sets its own output `constant_mask`, so that's what's in WASM memory now
+			port.buffer.constant_mask = audioThread->get((r.audioOutputs + portIndex)[&wclap_audio_buffer::constant_mask]);
+			if (buffer.data32) {
+				buffer.constant_mask = copyChannelsOut(port.block, buffer.data32, port.channelCount, process->frames_count, r.maxFrames, port.buffer.constant_mask);
+			} else {
+				buffer.constant_mask = copyChannelsOut(port.block, buffer.data64, port.channelCount, process->frames_count, r.maxFrames, port.buffer.constant_mask);
+			}
+		}
+		return resultCode;
+	}
+
 	clap_process_status pluginProcess(const clap_process *process) {
+		auto *eventsIn = process->in_events;
+		if (wakeRequested.exchange(false)) wake();
+		bool inputQuiet = !eventsIn->size(eventsIn) && buffersQuiet(process->audio_inputs, process->audio_inputs_count, process->frames_count);
+		if (inputQuiet && canSleep()) return processAsleep(process);
+		quietInputFrames = inputQuiet ? quietInputFrames + process->frames_count : 0;
+
+		auto status = (resident && residentMatches(process)) ? processResident(process) : processBlock(process);
+		lastStatus = status;
+		lastOutputQuiet = (status == CLAP_PROCESS_CONTINUE_IF_NOT_QUIET) && buffersQuiet(process->audio_outputs, process->audio_outputs_count, process->frames_count);
+		return status;
+	}
+	clap_process_status processBlock(const clap_process *process) {
+		if (!blockFitsArena(process)) {
+			// More channels/frames than we reserved for: fail the block (with silence) rather than calling `malloc()` on the audio thread
+			++audioArenaOverflows;
+			requestOverflowReport();
+			silenceOutputs(process);
+			return CLAP_PROCESS_ERROR;
+		}
+
 		auto scoped = arena->scoped(); // use the audio-thread arena
 
 		auto inEvents = scoped.copyAcross(module.inputEventsTemplate);
@@ -299,14 +779,8 @@ private:
 
 		// Input/output events
 		std::unique_lock<std::recursive_mutex> lock{hostEventsMutex};
-		inputEvents.resize(0);
-		// Copy across (a recognised/translatable subset of) input events
-		auto *eventsIn = process->in_events;
-		uint32_t count = eventsIn->size(eventsIn);
-		for (uint32_t i = 0; i < count; ++i) {
-			tryCopyInputEvent(scoped, eventsIn->get(eventsIn, i));
-		}
-		hostOutputEvents = process->out_events;
+		copyInputEvents(scoped, process->in_events);
+		setHostOutputEvents(process->out_events);
 
 		// The process structure
 		wclap_process wProcess{
@@ -326,29 +800,34 @@ private:
 			wProcess.transport = scoped.copyAcross(wTransport);
 		}
 
-		auto translateBuffer = [&](const clap_audio_buffer &buffer, Pointer<const wclap_audio_buffer> wBufferPtr){
+		auto translateBuffer = [&](const clap_audio_buffer &buffer, Pointer<const wclap_audio_buffer> wBufferPtr, bool wclap64, bool isOutput){
 			wclap_audio_buffer wBuffer{
 				.data32={0},
 				.data64={0},
 				.channel_count=buffer.channel_count,
 				.latency=buffer.latency,
-				.constant_mask=buffer.constant_mask
+				// Output masks start clear, so we only trust bits the WCLAP sets during this call (the host's are whatever we wrote back last time)
+				.constant_mask=(isOutput ? 0 : buffer.constant_mask)
 			};
-			// Copy audio data across
-			if (buffer.data32) {
-				wBuffer.data32 = scoped.array<Pointer<float>>(wBuffer.channel_count);
+			// Copy audio data across: each port's channels are one contiguous block, so it's a single bounds-check
+			auto copyChannels = [&](auto *const *channels, auto &wChannels, auto wasmSample) {
+				using Sample = decltype(wasmSample); // might not match the host's samples
+				auto frames = wProcess.frames_count;
+				wChannels = scoped.array<Pointer<Sample>>(wBuffer.channel_count);
+				auto block = scoped.array<Sample>(size_t(wBuffer.channel_count)*frames);
+				copyChannelsIn<Sample>(block, channels, wBuffer.channel_count, frames, frames, wBuffer.constant_mask);
+				auto *channelPtrs = audioThread->view(wChannels, wBuffer.channel_count);
+				if (!channelPtrs) return;
 				for (uint32_t c = 0; c < wBuffer.channel_count; ++c) {
-					auto array = scoped.array<float>(wProcess.frames_count);
-					audioThread->setArray(array, buffer.data32[c], wProcess.frames_count);
-					audioThread->set(wBuffer.data32, array, c);
+					channelPtrs[c] = block + c*frames;
 				}
-			}
+			};
+			if (buffer.data32) copyChannels(buffer.data32, wBuffer.data32, float());
 			if (buffer.data64) {
-				wBuffer.data64 = scoped.array<Pointer<double>>(wBuffer.channel_count);
-				for (uint32_t c = 0; c < wBuffer.channel_count; ++c) {
-					auto array = scoped.array<double>(wProcess.frames_count);
-					audioThread->setArray(array, buffer.data64[c], wProcess.frames_count);
-					audioThread->set(wBuffer.data64, array, c);
+				if (wclap64) {
+					copyChannels(buffer.data64, wBuffer.data64, double());
+				} else if (!buffer.data32) {
+					copyChannels(buffer.data64, wBuffer.data32, float());
 				}
 			}
 			audioThread->set(wBufferPtr.cast<wclap_audio_buffer>(), wBuffer);
@@ -356,11 +835,11 @@ private:
 		// Audio inputs
 		wProcess.audio_inputs = scoped.array<const wclap_audio_buffer>(wProcess.audio_inputs_count);
 		for (uint32_t portIndex = 0; portIndex < wProcess.audio_inputs_count; ++portIndex) {
-			translateBuffer(process->audio_inputs[portIndex], wProcess.audio_inputs + portIndex);
+			translateBuffer(process->audio_inputs[portIndex], wProcess.audio_inputs + portIndex, wclapSupports64(true, portIndex), false);
 		}
 		wProcess.audio_outputs = scoped.array<wclap_audio_buffer>(wProcess.audio_outputs_count);
 		for (uint32_t portIndex = 0; portIndex < wProcess.audio_outputs_count; ++portIndex) {
-			translateBuffer(process->audio_outputs[portIndex], wProcess.audio_outputs + portIndex);
+			translateBuffer(process->audio_outputs[portIndex], wProcess.audio_outputs + portIndex, wclapSupports64(false, portIndex), true);
 		}
 
 		// Ready - copy the process structure across and call
@@ -373,24 +852,66 @@ private:
 		for (uint32_t portIndex = 0; portIndex < wProcess.audio_outputs_count; ++portIndex) {
 			auto &buffer = process->audio_outputs[portIndex];
 			auto wBuffer = audioThread->get(wProcess.audio_outputs, portIndex);
-			if (buffer.data32) {
-				for (uint32_t c = 0; c < buffer.channel_count; ++c) {
-					Pointer<float> channelPtr = audioThread->get(wBuffer.data32, c);
-					audioThread->getArray(channelPtr, buffer.data32[c], wProcess.frames_count);
-					checkBuffers(buffer.data32[c], wProcess.frames_count);
-				}
+			// We allocated each port's channels contiguously, so copy back the whole block at once
+			if (buffer.data32 && buffer.channel_count) {
+				Pointer<float> block = audioThread->get(wBuffer.data32, 0);
+				buffer.constant_mask = copyChannelsOut(block, buffer.data32, buffer.channel_count, wProcess.frames_count, wProcess.frames_count, wBuffer.constant_mask);
 			}
-			if (buffer.data64) {
-				for (uint32_t c = 0; c < buffer.channel_count; ++c) {
-					Pointer<double> channelPtr = audioThread->get(wBuffer.data64, c);
-					audioThread->getArray(channelPtr, buffer.data64[c], wProcess.frames_count);
-					checkBuffers(buffer.data64[c], wProcess.frames_count);
+			if (buffer.data64 && buffer.channel_count) {
+				if (wclapSupports64(false, portIndex)) {
+					Pointer<double> block = audioThread->get(wBuffer.data64, 0);
+					buffer.constant_mask = copyChannelsOut(block, buffer.data64, buffer.channel_count, wProcess.frames_count, wProcess.frames_count, wBuffer.constant_mask);
+				} else if (!buffer.data32) {
+					Pointer<float> block = audioThread->get(wBuffer.data32, 0);
+					buffer.constant_mask = copyChannelsOut(block, buffer.data64, buffer.channel_count, wProcess.frames_count, wProcess.frames_count, wBuffer.constant_mask);
 				}
 			}
 		}
 		
 		return resultCode;
 	}
+	// Copies a port's channels into WASM memory (`stride` apart), filling constant channels from their first sample instead of reading the whole thing.  Converts double -> float if the WCLAP doesn't support 64-bit.
+	template<class W, class H>
+	void copyChannelsIn(Pointer<W> block, const H * const *channels, uint32_t channelCount, uint32_t frames, size_t stride, uint64_t constantMask) {
+		if (!channelCount) return;
+		auto *wasmBlock = audioThread->view(block, (channelCount - 1)*stride + frames);
+		if (!wasmBlock) return;
+		for (uint32_t c = 0; c < channelCount; ++c) {
+			auto *wasmChannel = wasmBlock + c*stride;
+			if (isConstant(constantMask, c)) {
+				std::fill_n(wasmChannel, frames, frames ? W(channels[c][0]) : W(0));
+			} else if constexpr (std::is_same_v<W, H>) {
+				std::memcpy(wasmChannel, channels[c], sizeof(W)*frames);
+			} else {
+				wclap_bridge::convertSamples(wasmChannel, channels[c], frames);
+			}
+		}
+	}
+	// Copies a port's channels back, trusting the WCLAP's `constant_mask` so we only check one sample of the constant ones.  Returns the mask for the host.
+	template<class W, class H>
+	uint64_t copyChannelsOut(Pointer<W> block, H * const *channels, uint32_t channelCount, uint32_t frames, size_t stride, uint64_t constantMask) {
+		if (!channelCount) return 0;
+		auto *wasmBlock = audioThread->view(block, (channelCount - 1)*stride + frames);
+		if (!wasmBlock) return 0;
+		for (uint32_t c = 0; c < channelCount; ++c) {
+			auto *wasmChannel = wasmBlock + c*stride;
+			if (isConstant(constantMask, c)) {
+				H value = frames ? H(wasmChannel[0]) : H(0);
+				checkBuffers(&value, 1);
+				std::fill_n(channels[c], frames, value);
+			} else if constexpr (std::is_same_v<W, H>) {
+				std::memcpy(channels[c], wasmChannel, sizeof(H)*frames);
+				checkBuffers(channels[c], frames);
+			} else {
+				wclap_bridge::convertSamplesChecked(channels[c], wasmChannel, frames); // includes `checkBuffers()`
+			}
+		}
+		return (channelCount >= 64) ? constantMask : constantMask&((uint64_t(1) << channelCount) - 1);
+	}
+	static bool isConstant(uint64_t constantMask, uint32_t channel) {
+		return channel < 64 && (constantMask&(uint64_t(1) << channel));
+	}
+
 	template<class S>
 	void checkBuffers(S *buffer, size_t length) {
 		static constexpr S limit = 100;
@@ -401,30 +922,41 @@ private:
 	}
 
 	void pluginOnMainThread() {
-		mainThread->call(ptr[&wclap_plugin::on_main_thread], ptr);
+		if (overflowReportRequested) reportOverflows();
+		drainWebviewMessages();
+		if (wclapCallbackRequested.exchange(false)) {
+			mainThread->call(ptr[&wclap_plugin::on_main_thread], ptr);
+		}
 	}
 
 	const void * pluginGetExtension(const char *pluginExtId) {
+		using Extension = wclap_bridge::Extension;
+		auto extension = wclap_bridge::lookupExtension(pluginExtId, std::strlen(pluginExtId));
+		if (extension == Extension::unknown) return nullptr;
+
 		auto scoped = module.arenaPool.scoped();
 		auto extIdPtr = scoped.writeString(pluginExtId);
 		auto wclapExt = mainThread->call(ptr[&wclap_plugin::get_extension], ptr, extIdPtr);
 		if (!wclapExt) return nullptr;
 		
-		if (!std::strcmp(pluginExtId, CLAP_EXT_AMBISONIC)) {
+		switch (extension) {
+		case Extension::ambisonic: {
 			ambisonicExt = wclapExt.cast<const wclap_plugin_ambisonic>();
 			static const clap_plugin_ambisonic ext{
 				.is_config_supported=clapPluginMethod<&Plugin::ambisonic_is_config_supported>(),
 				.get_config=clapPluginMethod<&Plugin::ambisonic_get_config>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_AUDIO_PORTS_ACTIVATION)) {
+		}
+		case Extension::audioPortsActivation: {
 			audioPortsActivationExt = wclapExt.cast<const wclap_plugin_audio_ports_activation>();
 			static const clap_plugin_audio_ports_activation ext{
 				.can_activate_while_processing=clapPluginMethod<&Plugin::audioPortsActivation_can_activate_while_processing>(),
 				.set_active=clapPluginMethod<&Plugin::audioPortsActivation_set_active>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_AUDIO_PORTS_CONFIG)) {
+		}
+		case Extension::audioPortsConfig: {
 			audioPortsConfigExt = wclapExt.cast<const wclap_plugin_audio_ports_config>();
 			static const clap_plugin_audio_ports_config ext{
 				.count=clapPluginMethod<&Plugin::audioPortsConfig_count>(),
@@ -432,29 +964,33 @@ private:
 				.select=clapPluginMethod<&Plugin::audioPortsConfig_select>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_AUDIO_PORTS_CONFIG_INFO)) {
+		}
+		case Extension::audioPortsConfigInfo: {
 			audioPortsConfigInfoExt = wclapExt.cast<const wclap_plugin_audio_ports_config_info>();
 			static const clap_plugin_audio_ports_config_info ext{
 				.current_config=clapPluginMethod<&Plugin::audioPortsConfigInfo_current_config>(),
 				.get=clapPluginMethod<&Plugin::audioPortsConfigInfo_get>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_AUDIO_PORTS)) {
+		}
+		case Extension::audioPorts: {
 			audioPortsExt = wclapExt.cast<const wclap_plugin_audio_ports>();
 			static const clap_plugin_audio_ports ext{
 				.count=clapPluginMethod<&Plugin::audioPorts_count>(),
 				.get=clapPluginMethod<&Plugin::audioPorts_get>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_CONFIGURABLE_AUDIO_PORTS)) {
+		}
+		case Extension::configurableAudioPorts: {
 			configurableAudioPortsExt = wclapExt.cast<const wclap_plugin_configurable_audio_ports>();
 			static const clap_plugin_configurable_audio_ports ext{
 				.can_apply_configuration=clapPluginMethod<&Plugin::configurableAudioPorts_can_apply_configuration>(),
 				.apply_configuration=clapPluginMethod<&Plugin::configurableAudioPorts_apply_configuration>(),
 			};
 			return &ext;
+		}
 		// TODO: context-menu (CLAP_EXT_CONTEXT_MENU)
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_GUI)) {
+		case Extension::gui: {
 			static const clap_plugin_gui ext{
 				.is_api_supported=clapPluginMethod<&Plugin::gui_is_api_supported>(),
 				.get_preferred_api=clapPluginMethod<&Plugin::gui_get_preferred_api>(),
@@ -475,34 +1011,39 @@ private:
 			guiExt = wclapExt.cast<const wclap_plugin_gui>();
 			if (!webviewExt) webviewExt = wclapExt.cast<const wclap_plugin_webview>();
 			return guiExt ? &ext : nullptr; // depends on the WCLAP's webview extension, not the GUI one
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_LATENCY)) {
+		}
+		case Extension::latency: {
 			latencyExt = wclapExt.cast<const wclap_plugin_latency>();
 			static const clap_plugin_latency ext{
 				.get=clapPluginMethod<&Plugin::latency_get>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_NOTE_NAME)) {
+		}
+		case Extension::noteName: {
 			noteNameExt = wclapExt.cast<const wclap_plugin_note_name>();
 			static const clap_plugin_note_name ext{
 				.count=clapPluginMethod<&Plugin::noteName_count>(),
 				.get=clapPluginMethod<&Plugin::noteName_get>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_NOTE_PORTS)) {
+		}
+		case Extension::notePorts: {
 			notePortsExt = wclapExt.cast<const wclap_plugin_note_ports>();
 			static const clap_plugin_note_ports ext{
 				.count=clapPluginMethod<&Plugin::notePorts_count>(),
 				.get=clapPluginMethod<&Plugin::notePorts_get>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_PARAM_INDICATION)) {
+		}
+		case Extension::paramIndication: {
 			paramIndicationExt = wclapExt.cast<const wclap_plugin_param_indication>();
 			static const clap_plugin_param_indication ext{
 				.set_mapping=clapPluginMethod<&Plugin::paramIndication_set_mapping>(),
 				.set_automation=clapPluginMethod<&Plugin::paramIndication_set_automation>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_PARAMS)) {
+		}
+		case Extension::params: {
 			paramsExt = wclapExt.cast<const wclap_plugin_params>();
 			static const clap_plugin_params ext{
 				.count=clapPluginMethod<&Plugin::params_count>(),
@@ -513,79 +1054,91 @@ private:
 				.flush=clapPluginMethod<&Plugin::params_flush>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_PRESET_LOAD)) {
+		}
+		case Extension::presetLoad: {
 			presetLoadExt = wclapExt.cast<const wclap_plugin_preset_load>();
 			static const clap_plugin_preset_load ext{
 				.from_location=clapPluginMethod<&Plugin::presetLoad_from_location>(),
 			};
 			return &ext;
+		}
 		// skipping posix-fd-support
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_REMOTE_CONTROLS)) {
+		case Extension::remoteControls: {
 			remoteControlsExt = wclapExt.cast<const wclap_plugin_remote_controls>();
 			static const clap_plugin_remote_controls ext{
 				.count=clapPluginMethod<&Plugin::remoteControls_count>(),
 				.get=clapPluginMethod<&Plugin::remoteControls_get>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_RENDER)) {
+		}
+		case Extension::render: {
 			renderExt = wclapExt.cast<const wclap_plugin_render>();
 			static const clap_plugin_render ext{
 				.has_hard_realtime_requirement=clapPluginMethod<&Plugin::render_has_hard_realtime_requirement>(),
 				.set=clapPluginMethod<&Plugin::render_set>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_STATE_CONTEXT)) {
+		}
+		case Extension::stateContext: {
 			stateContextExt = wclapExt.cast<const wclap_plugin_state_context>();
 			static const clap_plugin_state_context ext{
 				.save=clapPluginMethod<&Plugin::stateContext_save>(),
 				.load=clapPluginMethod<&Plugin::stateContext_load>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_STATE)) {
+		}
+		case Extension::state: {
 			stateExt = wclapExt.cast<const wclap_plugin_state>();
 			static const clap_plugin_state ext{
 				.save=clapPluginMethod<&Plugin::state_save>(),
 				.load=clapPluginMethod<&Plugin::state_load>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_SURROUND)) {
+		}
+		case Extension::surround: {
 			surroundExt = wclapExt.cast<const wclap_plugin_surround>();
 			static const clap_plugin_surround ext{
 				.is_channel_mask_supported=clapPluginMethod<&Plugin::surround_is_channel_mask_supported>(),
 				.get_channel_map=clapPluginMethod<&Plugin::surround_get_channel_map>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_TAIL)) {
+		}
+		case Extension::tail: {
 			tailExt = wclapExt.cast<const wclap_plugin_tail>();
 			static const clap_plugin_tail ext{
 				.get=clapPluginMethod<&Plugin::tail_get>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_THREAD_POOL)) {
+		}
+		case Extension::threadPool: {
 			threadPoolExt = wclapExt.cast<const wclap_plugin_thread_pool>();
 			static const clap_plugin_thread_pool ext{
 				.exec=clapPluginMethod<&Plugin::threadPool_exec>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_TIMER_SUPPORT)) {
+		}
+		case Extension::timerSupport: {
 			timerSupportExt = wclapExt.cast<const wclap_plugin_timer_support>();
 			static const clap_plugin_timer_support ext{
 				.on_timer=clapPluginMethod<&Plugin::timerSupport_on_timer>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_TRACK_INFO)) {
+		}
+		case Extension::trackInfo: {
 			trackInfoExt = wclapExt.cast<const wclap_plugin_track_info>();
 			static const clap_plugin_track_info ext{
 				.changed=clapPluginMethod<&Plugin::trackInfo_changed>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_VOICE_INFO)) {
+		}
+		case Extension::voiceInfo: {
 			voiceInfoExt = wclapExt.cast<const wclap_plugin_voice_info>();
 			static const clap_plugin_voice_info ext{
 				.get=clapPluginMethod<&Plugin::voiceInfo_get>(),
 			};
 			return &ext;
-		} else if (!std::strcmp(pluginExtId, CLAP_EXT_WEBVIEW)) {
+		}
+		case Extension::webview: {
 			webviewExt = wclapExt.cast<const wclap_plugin_webview>();
 			static const clap_plugin_webview ext{
 				.get_uri=clapPluginMethod<&Plugin::webview_get_uri>(),
@@ -594,12 +1147,14 @@ private:
 			};
 			return &ext;
 		}
-		LOG_EXPR(pluginExtId);
+		default:
+			break;
+		}
 		return nullptr;
 	}
 
 	const char * translateWclapPortType(Instance &instance, Pointer<const char> portType) {
-		auto wclapPortType = mainThread->getString(portType, 16);
+		auto wclapPortType = mainThread->getStringView(portType, 16);
 		if (wclapPortType == CLAP_PORT_MONO) {
 			return CLAP_PORT_MONO;
 		} else if (wclapPortType == CLAP_PORT_STEREO) {
@@ -615,7 +1170,7 @@ private:
 		for (size_t i = 0; i < CLAP_NAME_SIZE; ++i) to[i] = from[i];
 	}
 	template<typename V>
-	void copy(V *to, V *from, size_t count) {
+	void copy(V *to, const V *from, size_t count) {
 		for (size_t i = 0; i < count; ++i) to[i] = from[i];
 	}
 
@@ -685,7 +1240,7 @@ private:
 		*info = clap_audio_port_info{
 			.id=wclapInfo.id,
 			.name="",
-			.flags=wclapInfo.flags,
+			.flags=wclapInfo.flags|CLAP_AUDIO_PORT_SUPPORTS_64BITS, // we convert if the WCLAP doesn't
 			.channel_count=wclapInfo.channel_count,
 			.port_type=translateWclapPortType(*mainThread, wclapInfo.port_type),
 			.in_place_pair=wclapInfo.in_place_pair
@@ -707,7 +1262,7 @@ private:
 		*info = clap_audio_port_info{
 			.id=wclapInfo.id,
 			.name="",
-			.flags=wclapInfo.flags,
+			.flags=wclapInfo.flags|CLAP_AUDIO_PORT_SUPPORTS_64BITS, // we convert if the WCLAP doesn't
 			.channel_count=wclapInfo.channel_count,
 			.port_type=translateWclapPortType(*mainThread, wclapInfo.port_type),
 			.in_place_pair=wclapInfo.in_place_pair
@@ -921,15 +1476,54 @@ private:
 	}
 
 	Pointer<const wclap_plugin_params> paramsExt;
+
+	// Hosts re-enumerate parameters a lot, so we fetch the whole table once and keep it until the WCLAP calls `rescan()` (with INFO/ALL) or `clear()`
+	std::recursive_mutex paramInfoMutex; // recursive because the WCLAP might call `rescan()` while we're filling
+	bool paramInfoValid = false;
+	size_t paramInfoGeneration = 0;
+	std::vector<clap_param_info> paramInfos;
+	std::vector<bool> paramInfoResults;
+
+	void invalidateParamInfo() {
+		std::unique_lock<std::recursive_mutex> lock{paramInfoMutex};
+		paramInfoValid = false;
+		++paramInfoGeneration;
+		invalidateParamValues();
+		invalidateParamText();
+	}
+	void fillParamInfo() {
+		std::unique_lock<std::recursive_mutex> lock{paramInfoMutex};
+		if (paramInfoValid) return;
+		auto generation = paramInfoGeneration;
+		auto count = mainThread->call(paramsExt[&wclap_plugin_params::count], ptr);
+		std::vector<clap_param_info> infos(count);
+		std::vector<bool> results(count);
+		// One arena scope for the whole table
+		auto scoped = module.arenaPool.scoped();
+		auto infoPtr = scoped.copyAcross(wclap_param_info{});
+		for (uint32_t i = 0; i < count; ++i) {
+			mainThread->set(infoPtr, wclap_param_info{});
+			results[i] = mainThread->call(paramsExt[&wclap_plugin_params::get_info], ptr, i, infoPtr);
+			translateParamInfo(mainThread->get(infoPtr), &infos[i]);
+		}
+		paramInfos = std::move(infos);
+		paramInfoResults = std::move(results);
+		paramInfoValid = (generation == paramInfoGeneration);
+	}
+
 	uint32_t params_count() {
-		return mainThread->call(paramsExt[&wclap_plugin_params::count], ptr);
+		std::unique_lock<std::recursive_mutex> lock{paramInfoMutex};
+		fillParamInfo();
+		return uint32_t(paramInfos.size());
 	}
 	bool params_get_info(uint32_t index, clap_param_info *info) {
-		auto scoped = module.arenaPool.scoped();
-		auto infoPtr = scoped.copyAcross(wclap_param_info{});
-		auto result = mainThread->call(paramsExt[&wclap_plugin_params::get_info], ptr, index, infoPtr);
-		auto wclapInfo = mainThread->get(infoPtr);
-		
+		std::unique_lock<std::recursive_mutex> lock{paramInfoMutex};
+		fillParamInfo();
+		if (index >= paramInfos.size()) return false;
+		*info = paramInfos[index];
+		return paramInfoResults[index];
+	}
+	void translateParamInfo(const wclap_param_info &wclapInfo, clap_param_info *info) {
 		void *cookie = nullptr;
 		// Store cookie, assuming host pointer size is larger enough (which is almost certainly true)
 		if constexpr (sizeof(cookie) >= sizeof(wclapInfo.cookie)) {
@@ -948,49 +1542,176 @@ private:
 		};
 		copyName(info->name, wclapInfo.name);
 		copy(info->module, wclapInfo.module, CLAP_PATH_SIZE);
-		
-		return result;
 	}
+	// Shadow copy of parameter values, so hosts polling every parameter don't make thousands of calls.  Each value is fetched on its first query, then kept current by watching `param_value` events in both directions.
+	struct ParamValue {
+		double value = 0;
+		uint64_t epoch = 0; // only trusted while this matches `paramValuesEpoch`
+	};
+	std::mutex paramValueMutex; // never held across WCLAP calls
+	std::unordered_map<clap_id, ParamValue> paramValues;
+	std::atomic<uint64_t> paramValuesEpoch = 1; // bumped when we can't trust the shadow values (state load, rescan, or missing an event)
+
+	void invalidateParamValues() {
+		++paramValuesEpoch;
+	}
+	// Called from the audio thread, so we don't wait for the lock or allocate
+	void observeParamValue(const clap_event_param_value &event) {
+		if (event.note_id != -1 || event.port_index != -1 || event.channel != -1 || event.key != -1) return; // polyphonic values don't change the main value
+		std::unique_lock<std::mutex> lock{paramValueMutex, std::try_to_lock};
+		if (!lock.owns_lock()) return invalidateParamValues();
+		auto iter = paramValues.find(event.param_id);
+		if (iter != paramValues.end()) iter->second = {event.value, paramValuesEpoch.load()};
+	}
+
 	bool params_get_value(clap_id paramId, double *value) {
+		uint64_t epoch;
+		{
+			std::lock_guard<std::mutex> lock{paramValueMutex};
+			epoch = paramValuesEpoch.load();
+			auto iter = paramValues.find(paramId);
+			if (iter != paramValues.end() && iter->second.epoch == epoch) {
+				*value = iter->second.value;
+				return true;
+			}
+		}
+		// Missing or stale - ask the WCLAP about just this one
 		auto scoped = module.arenaPool.scoped();
 		auto valuePtr = scoped.copyAcross(0.0);
 		auto result = mainThread->call(paramsExt[&wclap_plugin_params::get_value], ptr, paramId, valuePtr);
 		*value = mainThread->get(valuePtr);
+		if (result) {
+			std::lock_guard<std::mutex> lock{paramValueMutex};
+			auto &entry = paramValues[paramId];
+			// If an event updated it while we were asking, that's newer than our answer
+			if (entry.epoch != epoch) entry = {*value, epoch};
+		}
 		return result;
 	}
+
+	// UIs and automation lanes convert the same values back and forth a lot, so we remember the successful ones
+	struct ParamValueKey {
+		clap_id paramId;
+		uint64_t valueBits;
+		bool operator==(const ParamValueKey &other) const {
+			return paramId == other.paramId && valueBits == other.valueBits;
+		}
+	};
+	struct ParamTextKey {
+		clap_id paramId;
+		std::string text;
+		bool operator==(const ParamTextKey &other) const {
+			return paramId == other.paramId && text == other.text;
+		}
+	};
+	struct ParamKeyHash {
+		size_t operator()(const ParamValueKey &key) const {
+			return std::hash<uint64_t>{}(key.valueBits ^ (uint64_t(key.paramId) << 32));
+		}
+		size_t operator()(const ParamTextKey &key) const {
+			return std::hash<std::string_view>{}(key.text) ^ (size_t(key.paramId)*0x9e3779b9);
+		}
+	};
+	struct ParamText {
+		std::string text;
+		uint32_t capacity; // `text` might've been truncated to this
+	};
+	std::mutex paramTextMutex; // not held while calling the WCLAP, since it might call `rescan()`
+	LruCache<ParamValueKey, ParamText, ParamKeyHash> valueToTextCache{wclap_bridge::paramTextCacheSize};
+	LruCache<ParamTextKey, double, ParamKeyHash> textToValueCache{wclap_bridge::paramTextCacheSize};
+	std::atomic<bool> paramTextStale = false;
+
+	void invalidateParamText() {
+		paramTextStale = true;
+	}
+	// Must hold `paramTextMutex`
+	void checkParamTextStale() {
+		if (paramTextStale.exchange(false)) {
+			valueToTextCache.clear();
+			textToValueCache.clear();
+		}
+	}
+
 	bool params_value_to_text(clap_id paramId, double value, char *text, uint32_t textCapacity) {
+		if (!textCapacity) return false;
+		ParamValueKey key{paramId, 0};
+		std::memcpy(&key.valueBits, &value, sizeof(value));
+		auto copyOut = [&](std::string_view str) {
+			auto length = std::min(str.size(), size_t(textCapacity - 1));
+			std::memcpy(text, str.data(), length);
+			text[length] = 0;
+		};
+		{
+			std::lock_guard<std::mutex> lock{paramTextMutex};
+			checkParamTextStale();
+			auto *cached = valueToTextCache.find(key);
+			// Only usable if it wasn't truncated more than this request would be
+			if (cached && (cached->text.size() + 1 < cached->capacity || textCapacity <= cached->capacity)) {
+				copyOut(cached->text);
+				return true;
+			}
+		}
+
 		auto scoped = module.arenaPool.scoped();
 		auto wclapText = scoped.array<char>(textCapacity);
+		mainThread->set(wclapText, char(0));
 		auto result = mainThread->call(paramsExt[&wclap_plugin_params::value_to_text], ptr, paramId, value, wclapText, textCapacity);
-		mainThread->getArray(wclapText, text, textCapacity);
+		// Only copy up to the terminator, not the whole capacity
+		std::string str{mainThread->getStringView(wclapText, textCapacity - 1)};
+		copyOut(str);
+		if (result) {
+			std::lock_guard<std::mutex> lock{paramTextMutex};
+			checkParamTextStale();
+			valueToTextCache.insert(key, ParamText{std::move(str), textCapacity});
+		}
 		return result;
 	}
 	bool params_text_to_value(clap_id paramId, const char *text, double *value) {
+		ParamTextKey key{paramId, text};
+		{
+			std::lock_guard<std::mutex> lock{paramTextMutex};
+			checkParamTextStale();
+			if (auto *cached = textToValueCache.find(key)) {
+				*value = *cached;
+				return true;
+			}
+		}
+
 		auto scoped = module.arenaPool.scoped();
 		auto wclapText = scoped.writeString(text);
 		auto valuePtr = scoped.copyAcross(0.0);
 		auto result = mainThread->call(paramsExt[&wclap_plugin_params::text_to_value], ptr, paramId, wclapText, valuePtr);
 		*value = mainThread->get(valuePtr);
+		if (result) {
+			std::lock_guard<std::mutex> lock{paramTextMutex};
+			checkParamTextStale();
+			textToValueCache.insert(std::move(key), *value);
+		}
 		return result;
 	}
 	void params_flush(const clap_input_events *eventsIn, const clap_output_events *eventsOut) {
 		auto scoped = arena->scoped(); // use the audio-thread arena
-		auto inEvents = scoped.copyAcross(module.inputEventsTemplate);
-		auto outEvents = scoped.copyAcross(module.outputEventsTemplate);
-		module.setPlugin(inEvents, pluginListIndex);
-		module.setPlugin(outEvents, pluginListIndex);
+		Pointer<wclap_input_events> inEvents;
+		Pointer<wclap_output_events> outEvents;
+		if (resident) {
+			inEvents = resident->inEvents;
+			outEvents = resident->outEvents;
+		} else {
+			inEvents = scoped.copyAcross(module.inputEventsTemplate);
+			outEvents = scoped.copyAcross(module.outputEventsTemplate);
+			module.setPlugin(inEvents, pluginListIndex);
+			module.setPlugin(outEvents, pluginListIndex);
+		}
 
 		std::unique_lock<std::recursive_mutex> lock{hostEventsMutex};
-		// Copy across (a recognised/translatable subset of) input events
-		inputEvents.resize(0);
-		uint32_t count = eventsIn->size(eventsIn);
-		for (uint32_t i = 0; i < count; ++i) {
-			tryCopyInputEvent(scoped, eventsIn->get(eventsIn, i));
-		}
-		hostOutputEvents = eventsOut;
+		copyInputEvents(scoped, eventsIn);
+		if (sysexScratch.empty()) sysexScratch.resize(wclap_bridge::maxSysexBytes); // not activated yet, so we're on the main thread
+		setHostOutputEvents(eventsOut);
 
 		mainThread->call(paramsExt[&wclap_plugin_params::flush], ptr, inEvents, outEvents);
 
+		// Output from a flush means the WCLAP is doing something, so it shouldn't stay bypassed
+		if (outputEventsPushed) requestWake();
 		hostOutputEvents = nullptr;
 	}
 
@@ -1000,7 +1721,10 @@ private:
 		Pointer<const char> locationPtr{0}, loadKeyPtr{0};
 		if (location) locationPtr = scoped.writeString(location);
 		if (load_key) loadKeyPtr = scoped.writeString(load_key);
-		return mainThread->call(presetLoadExt[&wclap_plugin_preset_load::from_location], ptr, location_kind, locationPtr, loadKeyPtr);
+		auto result = mainThread->call(presetLoadExt[&wclap_plugin_preset_load::from_location], ptr, location_kind, locationPtr, loadKeyPtr);
+		invalidateParamValues();
+		invalidateParamText();
+		return result;
 	}
 
 	Pointer<const wclap_plugin_remote_controls> remoteControlsExt;
@@ -1033,51 +1757,84 @@ private:
 		return mainThread->call(renderExt[&wclap_plugin_render::set], ptr, mode);
 	}
 
+	// Threaded WCLAPs can (optionally) save/load state on their own `Instance`, so the main one isn't locked for the whole time.  Must hold `hostStreamsMutex`.
+	std::unique_ptr<Instance> maybeStateThread;
+	bool stateThreadFailed = false;
+	Instance * stateInstance() {
+		if (!wclap_bridge::separateStateInstance || !maybeAudioThread) return mainThread; // single-threaded WCLAPs only have one `Instance`
+		if (!maybeStateThread && !stateThreadFailed && module.prepareExtraInstance) {
+			// Needs the host functions (e.g. stream read/write) in its own function table
+			std::string failure;
+			maybeStateThread = module.prepareExtraInstance(module, failure);
+			if (!maybeStateThread) {
+				stateThreadFailed = true;
+				std::cerr << "WCLAP: " << failure << " for state instance, using the main thread" << std::endl;
+			}
+		}
+		return maybeStateThread ? maybeStateThread.get() : mainThread;
+	}
+
 	Pointer<const wclap_plugin_state_context> stateContextExt;
 	bool stateContext_save(const clap_ostream_t *stream, uint32_t context_type) {
+		std::unique_lock<std::recursive_mutex> lock{hostStreamsMutex};
+		auto *instance = stateInstance();
 		auto scoped = module.arenaPool.scoped(); // use any arena (main thread)
 		auto streamPtr = scoped.copyAcross(module.ostreamTemplate);
 		module.setPlugin(streamPtr, pluginListIndex);
 
-		std::unique_lock<std::recursive_mutex> lock{hostStreamsMutex};
 		hostOstream = stream;
-		auto result = mainThread->call(stateContextExt[&wclap_plugin_state_context::save], ptr, streamPtr, context_type);
+		streamInstance = instance;
+		auto result = instance->call(stateContextExt[&wclap_plugin_state_context::save], ptr, streamPtr, context_type);
 		hostOstream = nullptr;
+		streamInstance = nullptr;
 		return result;
 	}
 	bool stateContext_load(const clap_istream_t *stream, uint32_t context_type) {
+		std::unique_lock<std::recursive_mutex> lock{hostStreamsMutex};
+		auto *instance = stateInstance();
 		auto scoped = module.arenaPool.scoped(); // use any arena (main thread)
 		auto streamPtr = scoped.copyAcross(module.istreamTemplate);
 		module.setPlugin(streamPtr, pluginListIndex);
 
-		std::unique_lock<std::recursive_mutex> lock{hostStreamsMutex};
 		hostIstream = stream;
-		auto result = mainThread->call(stateContextExt[&wclap_plugin_state_context::load], ptr, streamPtr, context_type);
+		streamInstance = instance;
+		auto result = instance->call(stateContextExt[&wclap_plugin_state_context::load], ptr, streamPtr, context_type);
 		hostIstream = nullptr;
+		streamInstance = nullptr;
+		invalidateParamValues();
+		invalidateParamText();
 		return result;
 	}
 	
 	Pointer<const wclap_plugin_state> stateExt;
 	bool state_save(const clap_ostream_t *stream) {
+		std::unique_lock<std::recursive_mutex> lock{hostStreamsMutex};
+		auto *instance = stateInstance();
 		auto scoped = module.arenaPool.scoped(); // use any arena (main thread)
 		auto streamPtr = scoped.copyAcross(module.ostreamTemplate);
 		module.setPlugin(streamPtr, pluginListIndex);
 
-		std::unique_lock<std::recursive_mutex> lock{hostStreamsMutex};
 		hostOstream = stream;
-		auto result = mainThread->call(stateExt[&wclap_plugin_state::save], ptr, streamPtr);
+		streamInstance = instance;
+		auto result = instance->call(stateExt[&wclap_plugin_state::save], ptr, streamPtr);
 		hostOstream = nullptr;
+		streamInstance = nullptr;
 		return result;
 	}
 	bool state_load(const clap_istream_t *stream) {
+		std::unique_lock<std::recursive_mutex> lock{hostStreamsMutex};
+		auto *instance = stateInstance();
 		auto scoped = module.arenaPool.scoped(); // use any arena (main thread)
 		auto streamPtr = scoped.copyAcross(module.istreamTemplate);
 		module.setPlugin(streamPtr, pluginListIndex);
 
-		std::unique_lock<std::recursive_mutex> lock{hostStreamsMutex};
 		hostIstream = stream;
-		auto result = mainThread->call(stateExt[&wclap_plugin_state::load], ptr, streamPtr);
+		streamInstance = instance;
+		auto result = instance->call(stateExt[&wclap_plugin_state::load], ptr, streamPtr);
 		hostIstream = nullptr;
+		streamInstance = nullptr;
+		invalidateParamValues();
+		invalidateParamText();
 		return result;
 	}
 	
@@ -1167,36 +1924,25 @@ private:
 			auto mimeGuess = webview_gui::helpers::guessMediaType(path);
 			std::strncpy(mime, mimeGuess.c_str(), mimeCapacity);
 			
-			std::ifstream stream{*mapped, std::ios::binary|std::ios::ate};
-			if (!stream) {
+			// The WCLAP's own bundle doesn't change, so those stay mapped for other plugins/requests
+			bool isBundle = (std::strncmp(path, "/plugin.wclap/", 14) == 0);
+			auto file = isBundle ? module.resourceCache.open(*mapped) : wclap_bridge::MappedFile::open(*mapped);
+			if (!file) {
 				std::cerr << "WCLAP: couldn't open file: " << *mapped << std::endl;
 				return false;
 			}
-			
-			std::vector<char> buffer;
-			auto bufferSize = stream.tellg();
-			if (bufferSize > 100*1024*1024) {
-				std::cerr << "WCLAP: refused to serve webview UI resource of > 100MB: " << bufferSize << std::endl;
-				return false; // This is a webview UI, 100MB max file-size is more than generous
-			}
-			buffer.resize(bufferSize); // we opened at the end, so this is the file size
-			stream.seekg(0);
-			// Read entire file into memory at once
-			if (stream.read(buffer.data(), buffer.size())) {
-				std::cout << "WCLAP: read " << buffer.size() << " bytes for file: " << *mapped << std::endl;
-				size_t index = 0;
-				while (index < buffer.size()) {
-					auto result = ostream->write(ostream, (const void *)(buffer.data() + index), uint64_t(buffer.size() - index));
-					if (result <= 0) {
-						std::cerr << "WCLAP: failed to write to stream: " << result << std::endl;
-						return false;
-					}
-					index += result;
+
+			size_t index = 0;
+			while (index < file->size) {
+				auto chunk = std::min(file->size - index, wclap_bridge::webviewResourceChunk);
+				auto result = ostream->write(ostream, (const void *)(file->data + index), uint64_t(chunk));
+				if (result <= 0) {
+					std::cerr << "WCLAP: failed to write to stream: " << result << std::endl;
+					return false;
 				}
-				return true;
+				index += result;
 			}
-			std::cerr << "WCLAP: couldn't read file: " << *mapped << std::endl;
-			return false;
+			return true;
 		}
 
 		auto scoped = module.arenaPool.scoped();
@@ -1213,6 +1959,9 @@ private:
 		return result;
 	}
 	bool webview_receive(const void *buffer, uint32_t size) {
+		if (queueWebviewMessage(webviewToWclap, buffer, size, true)) return true;
+		// Too big (or too many) to queue, so deliver it now, after the queued ones
+		drainWebviewToWclap();
 		auto scoped = module.arenaPool.scoped();
 		auto bufferPtr = scoped.array<unsigned char>(size);
 		mainThread->setArray(bufferPtr, (const unsigned char *)buffer, size);
@@ -9,5 +9,46 @@ inline std::string pluginNamePrefix = "";
 inline std::string pluginNameSuffix = "";
 
 inline size_t maxLogStringLength = 8192;
+// Stack buffer used when a log string has to be copied to add a null terminator - longer strings are truncated
+static constexpr size_t maxLogStringBuffer = 8192;
+
+// Give each plugin from a single-threaded WCLAP its own instance (and memory), so they can process in parallel
+inline bool isolatePluginInstances = false;
+
+// Snapshot single-threaded WCLAPs after `clap_entry::init()`, and start isolated instances from that instead of re-running their initialisation
+inline bool snapshotAfterInit = false;
+
+// Save/load state for threaded WCLAPs on a separate `Instance`, so the main-thread one stays available
+inline bool separateStateInstance = false;
+
+// Entries in each plugin's `value_to_text()`/`text_to_value()` caches
+inline size_t paramTextCacheSize = 1024;
+
+// Webview resources from `/plugin.wclap/` stay memory-mapped (per module) for re-use, and are written to the host in chunks of this size
+inline size_t webviewResourceCacheSize = 64;
+static constexpr size_t webviewResourceChunk = 1024*1024;
+
+// Webview messages (both directions) are queued in storage allocated on first use (two batches per direction), and delivered in batches from `on_main_thread()`
+inline size_t webviewQueueBytes = 64*1024;
+inline size_t webviewQueueMessages = 256;
+// Optional: a queued webview message is dropped if a newer one has the same non-zero key
+inline uint64_t (*webviewCoalesceKey)(void *context, const void *message, uint32_t size, bool toWclap) = nullptr;
+inline void *webviewCoalesceContext = nullptr;
+
+// Per-plugin scratch space (reserved at activation) for sysex output events, since we can't allocate on the audio thread
+inline size_t maxSysexBytes = 65536;
+
+// Input events translated per process/flush, and the audio-arena space reserved for them - anything beyond this is dropped (and counted)
+inline size_t maxInputEvents = 4096;
+inline size_t inputEventBytes = 256*1024;
+
+// A `wclap_memory_lock_mode`: which WASM memory gets prefaulted and locked while plugins are active
+inline uint32_t memoryLockMode = 0;
+
+// Worker threads used by `wclap_open_async()`, started with the first request
+inline size_t asyncOpenThreads = 2;
+
+// Number of warm threads (each with an `Instance` ready) kept per threaded WCLAP, for `wasi::thread-spawn`
+inline size_t wasiThreadPoolSize = 0;
 
 }; // namespace
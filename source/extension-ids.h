@@ -0,0 +1,84 @@
+#pragma once
+
+#include "clap/all.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace wclap_bridge {
+
+// Every extension the bridge knows how to translate (in either direction)
+enum class Extension : uint8_t {
+	ambisonic, audioPortsActivation, audioPortsConfig, audioPortsConfigInfo, audioPorts, configurableAudioPorts, gui, latency, log, noteName, notePorts, paramIndication, params, presetLoad, remoteControls, render, stateContext, state, surround, tail, threadCheck, threadPool, timerSupport, trackInfo, voiceInfo, webview,
+	unknown
+};
+static constexpr size_t extensionCount = size_t(Extension::unknown);
+
+// Indexed by `Extension`
+static constexpr const char *extensionIds[extensionCount] = {
+	CLAP_EXT_AMBISONIC, CLAP_EXT_AUDIO_PORTS_ACTIVATION, CLAP_EXT_AUDIO_PORTS_CONFIG, CLAP_EXT_AUDIO_PORTS_CONFIG_INFO, CLAP_EXT_AUDIO_PORTS, CLAP_EXT_CONFIGURABLE_AUDIO_PORTS, CLAP_EXT_GUI, CLAP_EXT_LATENCY, CLAP_EXT_LOG, CLAP_EXT_NOTE_NAME, CLAP_EXT_NOTE_PORTS, CLAP_EXT_PARAM_INDICATION, CLAP_EXT_PARAMS, CLAP_EXT_PRESET_LOAD, CLAP_EXT_REMOTE_CONTROLS, CLAP_EXT_RENDER, CLAP_EXT_STATE_CONTEXT, CLAP_EXT_STATE, CLAP_EXT_SURROUND, CLAP_EXT_TAIL, CLAP_EXT_THREAD_CHECK, CLAP_EXT_THREAD_POOL, CLAP_EXT_TIMER_SUPPORT, CLAP_EXT_TRACK_INFO, CLAP_EXT_VOICE_INFO, CLAP_EXT_WEBVIEW
+};
+
+inline const char * extensionId(Extension ext) {
+	return (ext == Extension::unknown) ? "" : extensionIds[size_t(ext)];
+}
+
+constexpr uint64_t fnv1a(const char *str, size_t length) {
+	uint64_t hash = 0xcbf29ce484222325ull;
+	for (size_t i = 0; i < length; ++i) {
+		hash ^= (unsigned char)str[i];
+		hash *= 0x100000001b3ull;
+	}
+	return hash;
+}
+constexpr size_t constLength(const char *str) {
+	size_t length = 0;
+	while (str[length]) ++length;
+	return length;
+}
+
+// Perfect hash for the known IDs: we search (at compile-time) for a seed where none of them share a slot
+struct ExtensionTable {
+	static constexpr size_t slotBits = 7;
+	uint64_t seed = 0;
+	uint8_t slots[size_t(1) << slotBits] = {}; // `Extension` index + 1, or 0 for empty
+	uint8_t lengths[extensionCount] = {};
+	bool valid = false;
+
+	static constexpr size_t slot(uint64_t hash, uint64_t seed) {
+		return size_t(((hash ^ seed)*0x9e3779b97f4a7c15ull) >> (64 - slotBits));
+	}
+
+	static constexpr ExtensionTable make() {
+		for (uint64_t seed = 0; seed < 10000; ++seed) {
+			ExtensionTable table{};
+			table.seed = seed;
+			bool collision = false;
+			for (size_t i = 0; i < extensionCount && !collision; ++i) {
+				auto length = constLength(extensionIds[i]);
+				auto s = slot(fnv1a(extensionIds[i], length), seed);
+				collision = (table.slots[s] != 0);
+				table.slots[s] = uint8_t(i + 1);
+				table.lengths[i] = uint8_t(length);
+			}
+			if (!collision) {
+				table.valid = true;
+				return table;
+			}
+		}
+		return {};
+	}
+};
+inline constexpr ExtensionTable extensionTable = ExtensionTable::make();
+static_assert(extensionTable.valid, "couldn't find a perfect hash for the extension IDs");
+
+// No allocation, one hash and (at most) one comparison
+inline Extension lookupExtension(const char *str, size_t length) {
+	auto index = extensionTable.slots[ExtensionTable::slot(fnv1a(str, length), extensionTable.seed)];
+	if (!index) return Extension::unknown;
+	--index;
+	if (extensionTable.lengths[index] != length || std::memcmp(extensionIds[index], str, length)) return Extension::unknown;
+	return Extension(index);
+}
+
+}; // namespace
@@ -4,14 +4,19 @@
 
 using InstanceGroup = wclap_wasmtime::InstanceGroup;
 using Instance = wclap::Instance<wclap_wasmtime::InstanceImpl>;
+using EngineOptions = wclap_wasmtime::EngineOptions;
+using MemoryFootprint = wclap_wasmtime::MemoryFootprint;
 
 InstanceGroup * createInstanceGroup(const unsigned char *wasmBytes, size_t wasmLength, const char *wclapDir, const char *presetDir, const char *cacheDir, const char *varDir) {
 	return new InstanceGroup(wasmBytes, wasmLength, wclapDir, presetDir, cacheDir, varDir);
 }
 
-bool instanceGlobalInit(unsigned int timeLimitMs) {
-	return wclap_wasmtime::InstanceGroup::globalInit(timeLimitMs);
+bool instanceGlobalInit(const EngineOptions &options) {
+	return wclap_wasmtime::InstanceGroup::globalInit(options);
 }
 void instanceGlobalDeinit() {
 	return wclap_wasmtime::InstanceGroup::globalDeinit();
 }
+MemoryFootprint instanceMemoryFootprint() {
+	return wclap_wasmtime::memoryFootprint();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstddef>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+namespace wclap_bridge {
+
+// Bounded map which evicts the least-recently-used entry.  Not thread-safe.
+template<class Key, class Value, class Hash=std::hash<Key>>
+struct LruCache {
+	LruCache(size_t capacity) : capacity(capacity) {}
+
+	// Returns `nullptr` if not found, otherwise marks the entry as most recently used
+	const Value * find(const Key &key) {
+		auto iter = index.find(key);
+		if (iter == index.end()) return nullptr;
+		entries.splice(entries.begin(), entries, iter->second);
+		return &iter->second->second;
+	}
+
+	void insert(const Key &key, Value value) {
+		if (!capacity) return;
+		auto iter = index.find(key);
+		if (iter != index.end()) {
+			iter->second->second = std::move(value);
+			entries.splice(entries.begin(), entries, iter->second);
+			return;
+		}
+		if (entries.size() >= capacity) {
+			index.erase(entries.back().first);
+			entries.pop_back();
+		}
+		entries.emplace_front(key, std::move(value));
+		index.emplace(key, entries.begin());
+	}
+
+	void clear() {
+		index.clear();
+		entries.clear();
+	}
+
+	size_t size() const {
+		return entries.size();
+	}
+
+private:
+	size_t capacity;
+	using Entry = std::pair<Key, Value>;
+	std::list<Entry> entries; // most recent first
+	std::unordered_map<Key, typename std::list<Entry>::iterator, Hash> index;
+};
+
+}; // namespace
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "./lru-cache.h"
+
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#ifdef _WIN32
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <fcntl.h>
+#	include <sys/mman.h>
+#	include <sys/stat.h>
+#	include <unistd.h>
+#endif
+
+namespace wclap_bridge {
+
+// Read-only memory-mapped file
+struct MappedFile {
+	const unsigned char *data = nullptr;
+	size_t size = 0;
+	std::filesystem::file_time_type modified;
+
+	static std::shared_ptr<const MappedFile> open(const std::string &path) {
+		std::error_code error;
+		auto modified = std::filesystem::last_write_time(path, error);
+		if (error) return nullptr;
+		auto file = std::shared_ptr<MappedFile>(new MappedFile());
+		file->modified = modified;
+		if (!file->map(path)) return nullptr;
+		return file;
+	}
+
+	~MappedFile() {
+#ifdef _WIN32
+		if (data) UnmapViewOfFile(data);
+		if (mapping) CloseHandle(mapping);
+#else
+		if (data) munmap((void *)data, size);
+#endif
+	}
+	MappedFile(const MappedFile &other) = delete;
+
+private:
+	MappedFile() {}
+
+#ifdef _WIN32
+	HANDLE mapping = nullptr;
+
+	bool map(const std::string &path) {
+		auto nativePath = std::filesystem::path(path);
+		HANDLE handle = CreateFileW(nativePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle == INVALID_HANDLE_VALUE) return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(handle, &fileSize)) {
+			CloseHandle(handle);
+			return false;
+		}
+		size = size_t(fileSize.QuadPart);
+		if (!size) { // can't map an empty file
+			CloseHandle(handle);
+			return true;
+		}
+		mapping = CreateFileMappingW(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(handle); // the mapping keeps it open
+		if (!mapping) return false;
+		data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		return data;
+	}
+#else
+	bool map(const std::string &path) {
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+		struct stat info;
+		if (fstat(fd, &info) || !S_ISREG(info.st_mode)) {
+			close(fd);
+			return false;
+		}
+		size = size_t(info.st_size);
+		if (!size) { // can't map an empty file
+			close(fd);
+			return true;
+		}
+		void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+		close(fd); // the mapping keeps it open
+		if (mapped == MAP_FAILED) return false;
+		data = (const unsigned char *)mapped;
+		return true;
+	}
+#endif
+};
+
+// Shared between threads, and re-maps files which have changed on disk
+struct MappedFileCache {
+	MappedFileCache(size_t capacity) : files(capacity) {}
+
+	std::shared_ptr<const MappedFile> open(const std::string &path) {
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			if (auto *cached = files.find(path)) {
+				std::error_code error;
+				auto modified = std::filesystem::last_write_time(path, error);
+				if (!error && modified == (*cached)->modified) return *cached;
+			}
+		}
+		auto file = MappedFile::open(path);
+		if (file) {
+			std::lock_guard<std::mutex> lock{mutex};
+			files.insert(path, file);
+		}
+		return file;
+	}
+
+private:
+	std::mutex mutex;
+	LruCache<std::string, std::shared_ptr<const MappedFile>> files;
+};
+
+}; // namespace
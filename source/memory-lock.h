@@ -0,0 +1,149 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+#ifdef _WIN32
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <sys/mman.h>
+#	include <unistd.h>
+#endif
+
+namespace wclap_bridge {
+
+// Across all WCLAPs, so hosts can stay inside `RLIMIT_MEMLOCK` (or the Windows working-set limit)
+inline std::atomic<uint64_t> lockedMemoryBytes = 0;
+
+// The OS doesn't count locks, so overlapping ranges share reference-counted page-aligned segments, and each page is locked once
+struct LockedPages {
+	void acquire(uintptr_t begin, uintptr_t end) {
+		std::lock_guard<std::mutex> lock{mutex};
+		split(begin);
+		split(end);
+		auto pos = begin;
+		auto it = segments.lower_bound(begin);
+		while (pos < end) {
+			if (it != segments.end() && it->first == pos) {
+				++it->second.refs;
+				pos = it->second.end;
+				++it;
+			} else {
+				// A gap nobody has locked yet
+				auto gapEnd = (it != segments.end() && it->first < end) ? it->first : end;
+				segments.emplace_hint(it, pos, Segment{gapEnd, 1, lockRegion(pos, gapEnd - pos)});
+				pos = gapEnd;
+			}
+		}
+	}
+	void release(uintptr_t begin, uintptr_t end) {
+		std::lock_guard<std::mutex> lock{mutex};
+		// Segments are never merged, so `acquire()` left boundaries at `begin` and `end`
+		auto it = segments.lower_bound(begin);
+		while (it != segments.end() && it->first < end) {
+			if (--it->second.refs) {
+				++it;
+				continue;
+			}
+			if (it->second.locked) unlockRegion(it->first, it->second.end - it->first);
+			it = segments.erase(it);
+		}
+	}
+
+private:
+	struct Segment {
+		uintptr_t end;
+		size_t refs;
+		bool locked;
+	};
+	std::mutex mutex;
+	std::map<uintptr_t, Segment> segments; // keyed by start, non-overlapping
+
+	// Makes sure no segment straddles `at`
+	void split(uintptr_t at) {
+		auto it = segments.upper_bound(at);
+		if (it == segments.begin()) return;
+		--it;
+		if (it->first == at || it->second.end <= at) return;
+		auto tail = it->second;
+		it->second.end = at;
+		segments.emplace(at, tail);
+	}
+	static bool lockRegion(uintptr_t start, size_t size) {
+#ifdef _WIN32
+		bool locked = VirtualLock((void *)start, size);
+#else
+		bool locked = !mlock((void *)start, size);
+#endif
+		if (locked) {
+			lockedMemoryBytes += size;
+		} else {
+			warnOnce();
+		}
+		return locked;
+	}
+	static void unlockRegion(uintptr_t start, size_t size) {
+#ifdef _WIN32
+		VirtualUnlock((void *)start, size);
+#else
+		munlock((void *)start, size);
+#endif
+		lockedMemoryBytes -= size;
+	}
+	static void warnOnce() {
+		static std::atomic<bool> warned = false;
+		if (!warned.exchange(true)) std::cerr << "WCLAP: couldn't lock WASM memory (check RLIMIT_MEMLOCK / working-set size), only prefaulting it" << std::endl;
+	}
+};
+inline LockedPages lockedPages;
+
+// Faults in a range of (host-addressed) WASM memory and locks it into RAM, unlocking when destroyed (unless another range still covers those pages)
+struct LockedRange {
+	LockedRange(void *start, size_t size) {
+		if (!size) return;
+		auto page = pageSize();
+		begin = uintptr_t(start) & ~(uintptr_t(page) - 1);
+		end = (uintptr_t(start) + size + page - 1) & ~(uintptr_t(page) - 1);
+
+		prefault(page);
+		lockedPages.acquire(begin, end);
+		held = true;
+	}
+	~LockedRange() {
+		if (held) lockedPages.release(begin, end);
+	}
+	LockedRange(const LockedRange &other) = delete;
+	LockedRange(LockedRange &&other) : begin(other.begin), end(other.end), held(other.held) {
+		other.held = false;
+	}
+
+private:
+	uintptr_t begin = 0, end = 0;
+	bool held = false;
+
+	static size_t pageSize() {
+#ifdef _WIN32
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		return info.dwPageSize;
+#else
+		return size_t(sysconf(_SC_PAGESIZE));
+#endif
+	}
+	// Locking faults pages in anyway, but this still helps when the lock is refused
+	void prefault(size_t page) {
+		auto *bytes = (volatile unsigned char *)begin;
+		for (size_t i = 0; i < end - begin; i += page) {
+			(void)bytes[i];
+		}
+	}
+};
+
+}; // namespace
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+namespace wclap_bridge {
+
+// Variable-size messages packed into fixed storage (allocated on first use).  A message with a non-zero key replaces any queued message with the same key.
+struct MessageBatch {
+	MessageBatch(size_t capacityBytes, size_t maxMessages) : capacityBytes(capacityBytes), maxMessages(maxMessages) {}
+
+	bool push(const void *data, uint32_t size, uint64_t key) {
+		if (bytes.size() != capacityBytes) {
+			bytes.resize(capacityBytes);
+			records.reserve(maxMessages);
+		}
+		if (records.size() >= maxMessages || size > bytes.size() - used) return false;
+		if (key) {
+			for (auto &record : records) {
+				if (record.key == key) record.superseded = true;
+			}
+		}
+		std::memcpy(bytes.data() + used, data, size);
+		records.push_back({used, size, key, false});
+		used += size;
+		return true;
+	}
+
+	template<class Fn>
+	void forEach(Fn &&fn) const {
+		for (auto &record : records) {
+			if (!record.superseded) fn((const void *)(bytes.data() + record.offset), record.size);
+		}
+	}
+
+	void clear() {
+		records.clear(); // keeps capacity
+		used = 0;
+	}
+
+	bool empty() const {
+		return records.empty();
+	}
+
+private:
+	struct Record {
+		size_t offset;
+		uint32_t size;
+		uint64_t key;
+		bool superseded;
+	};
+	size_t capacityBytes, maxMessages;
+	std::vector<unsigned char> bytes;
+	size_t used = 0;
+	std::vector<Record> records;
+};
+
+// Many producers, and one consumer which drains everything queued so far without holding the lock
+struct MessageChannel {
+	MessageChannel(size_t capacityBytes, size_t maxMessages) : pending(capacityBytes, maxMessages), draining(capacityBytes, maxMessages) {}
+
+	// Returns false if there's no room.  Sets `wasEmpty` so the caller knows to schedule a drain.
+	bool push(const void *data, uint32_t size, uint64_t key, bool &wasEmpty) {
+		std::lock_guard<std::mutex> lock{pendingMutex};
+		wasEmpty = pending.empty();
+		return pending.push(data, size, key);
+	}
+
+	// Does nothing if called (through `fn`) from inside a drain on the same thread
+	template<class Fn>
+	void drain(Fn &&fn) {
+		if (drainingThread == std::this_thread::get_id()) return;
+		std::lock_guard<std::mutex> drainLock{drainMutex};
+		drainingThread = std::this_thread::get_id();
+		{
+			std::lock_guard<std::mutex> lock{pendingMutex};
+			std::swap(pending, draining);
+		}
+		draining.forEach(fn);
+		draining.clear();
+		drainingThread = std::thread::id{};
+	}
+
+private:
+	std::mutex pendingMutex, drainMutex;
+	std::atomic<std::thread::id> drainingThread{};
+	MessageBatch pending, draining;
+};
+
+}; // namespace
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <cstddef>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(__i386__)
+#	if defined(__GNUC__) || defined(__clang__)
+#		include <immintrin.h>
+#		define WCLAP_SAMPLE_CONVERT_AVX2 1
+#	endif
+#elif defined(__aarch64__)
+#	include <arm_neon.h>
+#	define WCLAP_SAMPLE_CONVERT_NEON 1
+#endif
+
+namespace wclap_bridge {
+
+// Converts between float/double buffers, for when the host and the WCLAP disagree on sample size.  The `Checked` ones also zero anything non-finite or too loud, like `Plugin::checkBuffers()`.
+namespace sample_convert {
+	static constexpr float limit = 100;
+
+	inline void toFloatScalar(float *out, const double *in, size_t length) {
+		for (size_t i = 0; i < length; ++i) out[i] = float(in[i]);
+	}
+	inline void toDoubleCheckedScalar(double *out, const float *in, size_t length) {
+		for (size_t i = 0; i < length; ++i) {
+			float v = in[i];
+			out[i] = (std::abs(v) < limit) ? double(v) : 0.0;
+		}
+	}
+
+#if WCLAP_SAMPLE_CONVERT_AVX2
+	__attribute__((target("avx2")))
+	inline void toFloatAvx2(float *out, const double *in, size_t length) {
+		size_t i = 0;
+		for (; i + 4 <= length; i += 4) {
+			_mm_storeu_ps(out + i, _mm256_cvtpd_ps(_mm256_loadu_pd(in + i)));
+		}
+		toFloatScalar(out + i, in + i, length - i);
+	}
+	__attribute__((target("avx2")))
+	inline void toDoubleCheckedAvx2(double *out, const float *in, size_t length) {
+		const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+		const __m256 limitV = _mm256_set1_ps(limit);
+		size_t i = 0;
+		for (; i + 8 <= length; i += 8) {
+			__m256 v = _mm256_loadu_ps(in + i);
+			// NaN compares false, so gets zeroed along with the too-loud values
+			__m256 ok = _mm256_cmp_ps(_mm256_and_ps(v, absMask), limitV, _CMP_LT_OQ);
+			v = _mm256_and_ps(v, ok);
+			_mm256_storeu_pd(out + i, _mm256_cvtps_pd(_mm256_castps256_ps128(v)));
+			_mm256_storeu_pd(out + i + 4, _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1)));
+		}
+		toDoubleCheckedScalar(out + i, in + i, length - i);
+	}
+
+	inline bool hasAvx2() {
+		static const bool avx2 = __builtin_cpu_supports("avx2");
+		return avx2;
+	}
+#elif WCLAP_SAMPLE_CONVERT_NEON
+	inline void toFloatNeon(float *out, const double *in, size_t length) {
+		size_t i = 0;
+		for (; i + 4 <= length; i += 4) {
+			float32x2_t lo = vcvt_f32_f64(vld1q_f64(in + i));
+			float32x2_t hi = vcvt_f32_f64(vld1q_f64(in + i + 2));
+			vst1q_f32(out + i, vcombine_f32(lo, hi));
+		}
+		toFloatScalar(out + i, in + i, length - i);
+	}
+	inline void toDoubleCheckedNeon(double *out, const float *in, size_t length) {
+		const float32x4_t limitV = vdupq_n_f32(limit);
+		size_t i = 0;
+		for (; i + 4 <= length; i += 4) {
+			float32x4_t v = vld1q_f32(in + i);
+			// NaN compares false, so gets zeroed along with the too-loud values
+			uint32x4_t ok = vcaltq_f32(v, limitV);
+			v = vreinterpretq_f32_u32(vandq_u32(vreinterpretq_u32_f32(v), ok));
+			vst1q_f64(out + i, vcvt_f64_f32(vget_low_f32(v)));
+			vst1q_f64(out + i + 2, vcvt_high_f64_f32(v));
+		}
+		toDoubleCheckedScalar(out + i, in + i, length - i);
+	}
+#endif
+}
+
+inline void convertSamples(float *out, const double *in, size_t length) {
+#if WCLAP_SAMPLE_CONVERT_AVX2
+	if (sample_convert::hasAvx2()) return sample_convert::toFloatAvx2(out, in, length);
+#elif WCLAP_SAMPLE_CONVERT_NEON
+	return sample_convert::toFloatNeon(out, in, length);
+#endif
+	sample_convert::toFloatScalar(out, in, length);
+}
+
+inline void convertSamplesChecked(double *out, const float *in, size_t length) {
+#if WCLAP_SAMPLE_CONVERT_AVX2
+	if (sample_convert::hasAvx2()) return sample_convert::toDoubleCheckedAvx2(out, in, length);
+#elif WCLAP_SAMPLE_CONVERT_NEON
+	return sample_convert::toDoubleCheckedNeon(out, in, length);
+#endif
+	sample_convert::toDoubleCheckedScalar(out, in, length);
+}
+
+}; // namespace
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "wclap-bridge.h"
+
+#include <iostream>
+#include <mutex>
+#include <atomic>
+#include <algorithm>
+
+#ifdef _WIN32
+#	ifndef NOMINMAX
+#		define NOMINMAX
+#	endif
+#	include <windows.h>
+#else
+#	include <pthread.h>
+#	include <sched.h>
+#	include <sys/resource.h>
+#	include <unistd.h>
+#	ifdef __linux__
+#		include <sys/syscall.h>
+#	endif
+#endif
+
+namespace wclap_bridge {
+
+inline std::mutex threadPolicyMutex;
+inline wclap_thread_policy threadPolicy{};
+
+inline void setThreadPolicy(const wclap_thread_policy *policy) {
+	std::lock_guard<std::mutex> lock{threadPolicyMutex};
+	threadPolicy = (policy ? *policy : wclap_thread_policy{});
+}
+
+// Applies the host's thread policy to the current thread for the lifetime of this object, then puts everything back (because pool workers go back to preparing instances afterwards).  `thread_stopped()` is only called if `thread_started()` accepted the thread.
+struct ThreadPolicyScope {
+	ThreadPolicyScope(uint32_t threadId) : threadId(threadId) {
+		{
+			std::lock_guard<std::mutex> lock{threadPolicyMutex};
+			policy = threadPolicy;
+		}
+		if (policy.thread_started && !policy.thread_started(policy.context, threadId)) return;
+		started = true;
+		if (policy.cpu_mask) setAffinity();
+		if (policy.realtime_priority > 0) {
+			if (!setRealtime()) warnOnce("couldn't set realtime priority for WCLAP thread");
+		}
+		if (!realtimeSet && policy.nice) setNice();
+	}
+	~ThreadPolicyScope() {
+		if (!started) return;
+		restore();
+		if (policy.thread_stopped) policy.thread_stopped(policy.context, threadId);
+	}
+	ThreadPolicyScope(const ThreadPolicyScope &other) = delete;
+
+	// Puts the thread's scheduling back early, returning `false` if any of it couldn't be (e.g. raising priority after `nice` needs privileges), in which case the thread shouldn't be reused
+	bool restore() {
+		if (!restoreScheduling()) return false;
+		affinitySet = realtimeSet = niceSet = false;
+		return true;
+	}
+
+private:
+	uint32_t threadId;
+	wclap_thread_policy policy;
+	bool started = false, affinitySet = false, realtimeSet = false, niceSet = false;
+
+	static void warnOnce(const char *message) {
+		static std::atomic<bool> warned = false;
+		if (!warned.exchange(true)) std::cerr << "WCLAP: " << message << std::endl;
+	}
+
+#ifdef _WIN32
+	DWORD_PTR prevAffinity = 0;
+	int prevPriority = THREAD_PRIORITY_NORMAL;
+
+	void setAffinity() {
+		prevAffinity = SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(policy.cpu_mask));
+		affinitySet = (prevAffinity != 0);
+		if (!affinitySet) warnOnce("couldn't set CPU affinity for WCLAP thread");
+	}
+	bool setRealtime() {
+		prevPriority = GetThreadPriority(GetCurrentThread());
+		realtimeSet = SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+		return realtimeSet;
+	}
+	void setNice() {
+		prevPriority = GetThreadPriority(GetCurrentThread());
+		niceSet = SetThreadPriority(GetCurrentThread(), policy.nice < 0 ? THREAD_PRIORITY_ABOVE_NORMAL : THREAD_PRIORITY_BELOW_NORMAL);
+	}
+	bool restoreScheduling() {
+		bool ok = true;
+		if (affinitySet) ok = SetThreadAffinityMask(GetCurrentThread(), prevAffinity) && ok;
+		if (realtimeSet || niceSet) ok = SetThreadPriority(GetCurrentThread(), prevPriority) && ok;
+		return ok;
+	}
+#else
+	int prevSchedPolicy = SCHED_OTHER;
+	sched_param prevSchedParam{};
+	int prevNice = 0;
+#	ifdef __linux__
+	cpu_set_t prevAffinity;
+
+	void setAffinity() {
+		if (pthread_getaffinity_np(pthread_self(), sizeof(prevAffinity), &prevAffinity)) return;
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		for (int cpu = 0; cpu < 64; ++cpu) {
+			if (policy.cpu_mask&(uint64_t(1) << cpu)) CPU_SET(cpu, &set);
+		}
+		affinitySet = !pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (!affinitySet) warnOnce("couldn't set CPU affinity for WCLAP thread");
+	}
+	// On Linux, `setpriority()` with a thread ID only affects that thread
+	id_t niceTarget() {
+		return id_t(syscall(SYS_gettid));
+	}
+#	else
+	void setAffinity() {
+		warnOnce("CPU affinity isn't supported on this platform");
+	}
+	id_t niceTarget() {
+		return 0; // affects the whole process, so we don't use it
+	}
+#	endif
+	bool setRealtime() {
+		if (pthread_getschedparam(pthread_self(), &prevSchedPolicy, &prevSchedParam)) return false;
+		sched_param param{};
+		param.sched_priority = std::min(policy.realtime_priority, sched_get_priority_max(SCHED_FIFO));
+		realtimeSet = !pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		return realtimeSet;
+	}
+	void setNice() {
+		auto target = niceTarget();
+		if (!target) return;
+		prevNice = getpriority(PRIO_PROCESS, target);
+		niceSet = !setpriority(PRIO_PROCESS, target, policy.nice);
+	}
+	bool restoreScheduling() {
+		bool ok = true;
+#	ifdef __linux__
+		if (affinitySet) ok = !pthread_setaffinity_np(pthread_self(), sizeof(prevAffinity), &prevAffinity) && ok;
+#	endif
+		if (realtimeSet) ok = !pthread_setschedparam(pthread_self(), prevSchedPolicy, &prevSchedParam) && ok;
+		if (niceSet) ok = !setpriority(PRIO_PROCESS, niceTarget(), prevNice) && ok;
+		return ok;
+	}
+#endif
+};
+
+}; // namespace
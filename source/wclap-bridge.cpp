@@ -5,36 +5,137 @@
 
 #include "config.h"
 #include "wclap-bridge.h"
+#include "thread-policy.h"
+#include "memory-lock.h"
+#include "worker-pool.h"
 
 #include "./instance.h"
 #include "./wclap-module.h"
 
 #include <mutex>
 #include <fstream>
+#include <cstring>
 
 std::mutex globalInitMutex;
-std::atomic<size_t> globalInitMs = 0;
+wclap_global_options_t globalOptions; // with the strings below instead of its pointers
+std::string globalTarget, globalCraneliftFlags;
 std::atomic<size_t> activeWclapCount = 0;
 std::atomic<bool> globalInitOK = false;
 
-bool wclap_global_init(unsigned int timeLimitMs) {
+wclap_bridge::WorkerPool asyncOpenPool;
+std::atomic<bool> asyncOpenShutdown = false;
+// Cancels any `wclap_open_async()` requests, and waits for the workers to finish
+static void stopAsyncOpens() {
+	asyncOpenShutdown = true;
+	asyncOpenPool.stop();
+	asyncOpenShutdown = false;
+}
+
+void wclap_global_options_default(wclap_global_options_t *options) {
+	std::memset(options, 0, sizeof(wclap_global_options_t));
+	options->version = WCLAP_GLOBAL_OPTIONS_VERSION;
+	options->memory_reservation = -1;
+	options->memory_reservation_for_growth = -1;
+	options->memory_guard_size = -1;
+	options->memory_init_cow = -1;
+	options->allocation_strategy = WCLAP_ALLOCATION_ON_DEMAND;
+	options->opt_level = WCLAP_OPT_LEVEL_DEFAULT;
+	options->wasm_simd = -1;
+	options->wasm_relaxed_simd = -1;
+	options->wasm_memory64 = -1;
+	options->parallel_compilation = -1;
+}
+
+// Copies only the fields known to `options->version`, so the result can be compared with `memcmp()` - strings are returned separately
+static wclap_global_options_t normalizeOptions(const wclap_global_options_t *options, std::string &target, std::string &craneliftFlags) {
+	wclap_global_options_t result;
+	wclap_global_options_default(&result);
+	if (options->version >= 1) {
+		result.time_limit_ms = options->time_limit_ms;
+		result.memory_reservation = options->memory_reservation;
+		result.memory_reservation_for_growth = options->memory_reservation_for_growth;
+		result.memory_guard_size = options->memory_guard_size;
+		result.memory_init_cow = options->memory_init_cow;
+		result.allocation_strategy = options->allocation_strategy;
+		result.pool_total_memories = options->pool_total_memories;
+		result.pool_total_instances = options->pool_total_instances;
+		result.pool_max_unused_warm_slots = options->pool_max_unused_warm_slots;
+		result.pool_max_memory_size = options->pool_max_memory_size;
+	}
+	if (options->version >= 2) {
+		result.opt_level = options->opt_level;
+		result.wasm_simd = options->wasm_simd;
+		result.wasm_relaxed_simd = options->wasm_relaxed_simd;
+		result.wasm_memory64 = options->wasm_memory64;
+		result.parallel_compilation = options->parallel_compilation;
+		target = options->target ? options->target : "";
+		craneliftFlags = options->cranelift_flags ? options->cranelift_flags : "";
+	}
+	return result;
+}
+
+static EngineOptions toEngineOptions(const wclap_global_options_t &options, const std::string &target, const std::string &craneliftFlags) {
+	EngineOptions engine;
+	engine.timeLimitMs = options.time_limit_ms;
+	engine.memoryReservation = options.memory_reservation;
+	engine.memoryReservationForGrowth = options.memory_reservation_for_growth;
+	engine.memoryGuardSize = options.memory_guard_size;
+	engine.memoryInitCow = options.memory_init_cow;
+	engine.pooling = (options.allocation_strategy == WCLAP_ALLOCATION_POOLING);
+	engine.poolTotalMemories = options.pool_total_memories;
+	engine.poolTotalInstances = options.pool_total_instances;
+	engine.poolMaxUnusedWarmSlots = options.pool_max_unused_warm_slots;
+	engine.poolMaxMemorySize = options.pool_max_memory_size;
+	engine.optLevel = options.opt_level;
+	engine.simd = options.wasm_simd;
+	engine.relaxedSimd = options.wasm_relaxed_simd;
+	engine.memory64 = options.wasm_memory64;
+	engine.parallelCompilation = options.parallel_compilation;
+	engine.target = target;
+	size_t start = 0;
+	while (start < craneliftFlags.size()) {
+		auto end = craneliftFlags.find(',', start);
+		if (end == std::string::npos) end = craneliftFlags.size();
+		if (end > start) engine.craneliftFlags.push_back(craneliftFlags.substr(start, end - start));
+		start = end + 1;
+	}
+	return engine;
+}
+
+bool wclap_global_init_with_options(const wclap_global_options_t *optionsIn) {
+	if (!optionsIn || !optionsIn->version || optionsIn->version > WCLAP_GLOBAL_OPTIONS_VERSION) {
+		std::cerr << "WCLAP: unsupported wclap_global_options version\n";
+		return false;
+	}
+	std::string target, craneliftFlags;
+	auto options = normalizeOptions(optionsIn, target, craneliftFlags);
+
 	std::lock_guard<std::mutex> lock{globalInitMutex};
-	auto ms = (size_t)timeLimitMs;
 	if (globalInitOK) {
-		if (ms == globalInitMs) return true;
+		if (!std::memcmp(&options, &globalOptions, sizeof(options)) && target == globalTarget && craneliftFlags == globalCraneliftFlags) return true;
+		stopAsyncOpens();
 		if (activeWclapCount > 0) {
 			std::cerr << "Tried to reconfigure WCLAP bridge while WCLAPs are still active\n";
 			abort();
 		}
 		instanceGlobalDeinit();
 	}
-	globalInitMs = ms;
-	globalInitOK = instanceGlobalInit(ms);
+	globalOptions = options;
+	globalTarget = target;
+	globalCraneliftFlags = craneliftFlags;
+	globalInitOK = instanceGlobalInit(toEngineOptions(options, target, craneliftFlags));
 	return globalInitOK;
 }
+bool wclap_global_init(unsigned int timeLimitMs) {
+	wclap_global_options_t options;
+	wclap_global_options_default(&options);
+	options.time_limit_ms = timeLimitMs;
+	return wclap_global_init_with_options(&options);
+}
 void wclap_global_deinit() {
 	std::lock_guard<std::mutex> lock{globalInitMutex};
 	if (!globalInitOK) return;
+	stopAsyncOpens();
 	if (activeWclapCount > 0) {
 		std::cerr << "Tried to de-init WCLAP bridge while WCLAPs are still active\n";
 		abort();
@@ -43,6 +144,17 @@ void wclap_global_deinit() {
 	globalInitOK = false;
 }
 
+bool wclap_get_memory_footprint(wclap_memory_footprint_t *footprint) {
+	if (!footprint || !globalInitOK) return false;
+	auto current = instanceMemoryFootprint();
+	footprint->stores = current.stores;
+	footprint->memories = current.memories;
+	footprint->memory_bytes = current.memoryBytes;
+	footprint->virtual_bytes = current.virtualBytes;
+	footprint->pool_bytes = current.poolBytes;
+	return true;
+}
+
 static std::string ensureTrailingSlash(const char *dirC) {
 	std::string dir = dirC;
 #ifdef _WIN32
@@ -53,7 +165,63 @@ static std::string ensureTrailingSlash(const char *dirC) {
 	return dir;
 }
 
-void * wclap_open_with_dirs(const char *wclapDir, const char *presetDir, const char *cacheDir, const char *varDir) {
+struct AsyncOpen {
+	std::string wclapDir;
+	std::optional<std::string> presetDir, cacheDir, varDir;
+	wclap_open_progress_t progress;
+	wclap_open_complete_t complete;
+	void *context;
+
+	std::recursive_mutex mutex; // held while calling back, so release can wait for that to finish
+	std::atomic<int> stage = WCLAP_OPEN_QUEUED;
+	void *result = nullptr;
+	std::atomic<bool> cancelled = false, released = false; // also read by the worker without the lock
+	std::atomic<int> refs = 2; // the host and the worker
+
+	bool stopping() const {
+		return cancelled || released || asyncOpenShutdown;
+	}
+	// Returns `false` if we should stop instead
+	bool setStage(wclap_open_stage newStage) {
+		std::lock_guard<std::recursive_mutex> lock{mutex};
+		if (stopping()) return false;
+		stage = newStage;
+		if (progress) progress(context, this, newStage);
+		return true;
+	}
+	void finish(void *wclap) {
+		{
+			std::lock_guard<std::recursive_mutex> lock{mutex};
+			if (stopping()) {
+				if (wclap) wclap_close(wclap);
+				wclap = nullptr;
+				stage = WCLAP_OPEN_CANCELLED;
+			} else {
+				char message[256] = "";
+				if (wclap && wclap_get_error(wclap, message, sizeof(message))) {
+					// e.g. `clap_entry::init()` failed - unlike `wclap_open()`, we don't hand over broken WCLAPs
+					std::cerr << "WCLAP: " << message << std::endl;
+					wclap_close(wclap);
+					wclap = nullptr;
+				}
+				stage = (wclap ? WCLAP_OPEN_DONE : WCLAP_OPEN_FAILED);
+			}
+			result = wclap;
+			if (!released && complete) complete(context, this, wclap);
+		}
+		unref();
+	}
+	void unref() {
+		if (--refs == 0) delete this;
+	}
+};
+
+static const char * optCStr(const std::optional<std::string> &str) {
+	return str ? str->c_str() : nullptr;
+}
+
+// `job` is optional, for reporting progress (and stopping early)
+static void * openWclap(const char *wclapDir, const char *presetDir, const char *cacheDir, const char *varDir, AsyncOpen *job) {
 	if (!globalInitOK) {
 		std::cerr << "WASM engine not configured - did wclap_global_init() succeed?\n";
 		return nullptr;
@@ -63,6 +231,7 @@ void * wclap_open_with_dirs(const char *wclapDir, const char *presetDir, const c
 		return nullptr;
 	}
 
+	if (job && !job->setStage(WCLAP_OPEN_READING)) return nullptr;
 	std::ifstream wasmFile{ensureTrailingSlash(wclapDir) + "module.wasm", std::ios::binary};
 	if (!wasmFile) {
 		wasmFile = std::ifstream{wclapDir, std::ios::binary};
@@ -78,6 +247,7 @@ void * wclap_open_with_dirs(const char *wclapDir, const char *presetDir, const c
 		return nullptr;
 	}
 
+	if (job && !job->setStage(WCLAP_OPEN_COMPILING)) return nullptr;
 	auto *instanceGroup = createInstanceGroup((unsigned char *)wasmBytes.data(), wasmBytes.size(), wclapDir, presetDir, cacheDir, varDir);
 	auto error = instanceGroup->error();
 	if (error) {
@@ -85,13 +255,74 @@ void * wclap_open_with_dirs(const char *wclapDir, const char *presetDir, const c
 		delete instanceGroup;
 		return nullptr;
 	}
-	
+
+	if (job) {
+		if (!job->setStage(WCLAP_OPEN_INSTANTIATING)) {
+			delete instanceGroup;
+			return nullptr;
+		}
+		instanceGroup->initHookContext = job;
+		instanceGroup->initHook = [](void *context) {
+			return ((AsyncOpen *)context)->setStage(WCLAP_OPEN_INITIALISING);
+		};
+	}
 	++activeWclapCount;
-	return new wclap_bridge::WclapModule(instanceGroup);
+	auto *wclap = new wclap_bridge::WclapModule(instanceGroup);
+	instanceGroup->initHook = nullptr;
+	return wclap;
+}
+
+void * wclap_open_with_dirs(const char *wclapDir, const char *presetDir, const char *cacheDir, const char *varDir) {
+	return openWclap(wclapDir, presetDir, cacheDir, varDir, nullptr);
 }
 void * wclap_open(const char *wclapDir) {
 	return wclap_open_with_dirs(wclapDir, nullptr, nullptr, nullptr);
 }
+
+void * wclap_open_async(const char *wclapDir, const char *presetDir, const char *cacheDir, const char *varDir, wclap_open_progress_t progress, wclap_open_complete_t complete, void *context) {
+	auto *job = new AsyncOpen();
+	job->wclapDir = (wclapDir ? wclapDir : "");
+	job->presetDir = InstanceGroup::optStr(presetDir);
+	job->cacheDir = InstanceGroup::optStr(cacheDir);
+	job->varDir = InstanceGroup::optStr(varDir);
+	job->progress = progress;
+	job->complete = complete;
+	job->context = context;
+	bool hasDir = wclapDir;
+	asyncOpenPool.push(wclap_bridge::asyncOpenThreads, [job, hasDir](){
+		void *wclap = nullptr;
+		if (!job->stopping()) {
+			wclap = openWclap(hasDir ? job->wclapDir.c_str() : nullptr, optCStr(job->presetDir), optCStr(job->cacheDir), optCStr(job->varDir), job);
+		}
+		job->finish(wclap);
+	});
+	return job;
+}
+wclap_open_stage wclap_open_async_stage(void *request) {
+	return wclap_open_stage(((AsyncOpen *)request)->stage.load());
+}
+void * wclap_open_async_result(void *request) {
+	auto *job = (AsyncOpen *)request;
+	std::lock_guard<std::recursive_mutex> lock{job->mutex};
+	return (job->stage == WCLAP_OPEN_DONE) ? job->result : nullptr;
+}
+void wclap_open_async_cancel(void *request) {
+	auto *job = (AsyncOpen *)request;
+	std::lock_guard<std::recursive_mutex> lock{job->mutex};
+	job->cancelled = true;
+}
+void wclap_open_async_release(void *request) {
+	auto *job = (AsyncOpen *)request;
+	{
+		std::lock_guard<std::recursive_mutex> lock{job->mutex};
+		job->released = true;
+	}
+	job->unref();
+}
+void wclap_set_async_open_threads(uint32_t threads) {
+	wclap_bridge::asyncOpenThreads = threads;
+}
+
 bool wclap_get_error(void *wclap, char *buffer, uint32_t bufferCapacity) {
 	return ((wclap_bridge::WclapModule *)wclap)->getError(buffer, (size_t)bufferCapacity);
 }
@@ -126,6 +357,43 @@ void wclap_set_strings(const char *idPrefix, const char *namePrefix, const char
 	wclap_bridge::pluginNameSuffix = (nameSuffix ? nameSuffix : "");
 }
 
+void wclap_set_thread_pool_size(uint32_t warmThreads) {
+	wclap_bridge::wasiThreadPoolSize = warmThreads;
+}
+void wclap_set_isolated_instances(bool isolate) {
+	wclap_bridge::isolatePluginInstances = isolate;
+}
+void wclap_set_init_snapshots(bool enable) {
+	wclap_bridge::snapshotAfterInit = enable;
+}
+void wclap_set_state_instances(bool enable) {
+	wclap_bridge::separateStateInstance = enable;
+}
+void wclap_set_webview_coalescing(wclap_webview_coalesce_key_t key, void *context) {
+	wclap_bridge::webviewCoalesceKey = key;
+	wclap_bridge::webviewCoalesceContext = context;
+}
+void wclap_set_webview_queue_size(uint32_t bytes, uint32_t messages) {
+	wclap_bridge::webviewQueueBytes = bytes;
+	wclap_bridge::webviewQueueMessages = messages;
+}
+void wclap_set_max_sysex_bytes(uint32_t bytes) {
+	wclap_bridge::maxSysexBytes = bytes;
+}
+void wclap_set_input_event_budget(uint32_t maxEvents, uint32_t maxBytes) {
+	wclap_bridge::maxInputEvents = maxEvents;
+	wclap_bridge::inputEventBytes = maxBytes;
+}
+void wclap_set_memory_locking(wclap_memory_lock_mode mode) {
+	wclap_bridge::memoryLockMode = uint32_t(mode);
+}
+uint64_t wclap_locked_memory_bytes() {
+	return wclap_bridge::lockedMemoryBytes;
+}
+void wclap_set_thread_policy(const wclap_thread_policy_t *policy) {
+	wclap_bridge::setThreadPolicy(policy);
+}
+
 static const wclap_version_triple bridgeVersion = WCLAP_VERSION_INIT;
 const wclap_version_triple * wclap_bridge_version() {
 	return &bridgeVersion;
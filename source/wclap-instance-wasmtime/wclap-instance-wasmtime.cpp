@@ -3,6 +3,8 @@
 #include <atomic>
 #include <thread>
 #include <vector>
+#include <algorithm>
+#include <unordered_map>
 
 static std::atomic<wasm_engine_t *> globalWasmEngine;
 
@@ -28,7 +30,18 @@ std::unique_ptr<wclap::Instance<wclap_wasmtime::InstanceImpl>> wclap_wasmtime::I
 	return std::unique_ptr<wclap::Instance<wclap_wasmtime::InstanceImpl>>{thread};
 }
 
-bool wclap_wasmtime::InstanceGroup::globalInit(unsigned int timeLimitMs) {
+wclap_wasmtime::InstanceGroup * wclap_wasmtime::InstanceGroup::isolatedCopy() const {
+	if (wtSharedMemory || !wtModule || hasError()) return nullptr;
+	// Cloning only bumps a reference count, so the compiled code is shared
+	return new InstanceGroup(*this, wasmtime_module_clone(wtModule));
+}
+
+static bool globalPooling = false;
+bool wclap_wasmtime::InstanceGroup::pooledMemories() {
+	return globalPooling;
+}
+
+bool wclap_wasmtime::InstanceGroup::globalInit(const EngineOptions &options) {
 	wasm_config_t *config = wasm_config_new();
 	if (!config) {
 		std::cerr << "couldn't create Wasmtime config\n";
@@ -38,38 +51,211 @@ bool wclap_wasmtime::InstanceGroup::globalInit(unsigned int timeLimitMs) {
 	if (error) {
 		logError(error);
 		wasmtime_error_delete(error);
+		wasm_config_delete(config);
 		return false;
 	}
 
-	if (timeLimitMs > 0) {
+	if (options.timeLimitMs > 0) {
 		// enable epoch_interruption to prevent WCLAPs locking everything up - has a speed cost (10% according to docs)
 		wasmtime_config_epoch_interruption_set(config, true);
-		timeLimitEpochs = timeLimitMs/epochCounterMs + 2;
+		timeLimitEpochs = options.timeLimitMs/epochCounterMs + 2;
 		// TODO: wasmtime_store_epoch_deadline_callback(), to have a budget instead of a hard per-call limit
 	} else {
 		timeLimitEpochs = 0; // not active
 	}
-	
+
+	// Wasmtime's defaults (for 64-bit hosts) reserve 4GiB + guard pages per linear memory, which adds up with hundreds of stores
+	bool host64 = sizeof(void *) >= 8;
+	engineMemoryReservation = host64 ? (uint64_t(1) << 32) : 10*1024*1024;
+	engineMemoryReservationForGrowth = host64 ? (uint64_t(1) << 31) : 1024*1024;
+	engineMemoryGuardSize = host64 ? 32*1024*1024 : 2*1024*1024;
+	if (options.memoryReservation >= 0) {
+		wasmtime_config_memory_reservation_set(config, uint64_t(options.memoryReservation));
+		engineMemoryReservation = uint64_t(options.memoryReservation);
+	}
+	if (options.memoryReservationForGrowth >= 0) {
+		wasmtime_config_memory_reservation_for_growth_set(config, uint64_t(options.memoryReservationForGrowth));
+		engineMemoryReservationForGrowth = uint64_t(options.memoryReservationForGrowth);
+	}
+	if (options.memoryGuardSize >= 0) {
+		wasmtime_config_memory_guard_size_set(config, uint64_t(options.memoryGuardSize));
+		engineMemoryGuardSize = uint64_t(options.memoryGuardSize);
+	}
+	if (options.memoryInitCow >= 0) {
+		wasmtime_config_memory_init_cow_set(config, options.memoryInitCow > 0);
+	}
+
+	if (options.optLevel >= 0) {
+		static constexpr wasmtime_opt_level_t levels[] = {WASMTIME_OPT_LEVEL_NONE, WASMTIME_OPT_LEVEL_SPEED, WASMTIME_OPT_LEVEL_SPEED_AND_SIZE};
+		wasmtime_config_cranelift_opt_level_set(config, levels[std::min(options.optLevel, 2)]);
+	}
+	if (options.simd >= 0) wasmtime_config_wasm_simd_set(config, options.simd > 0);
+	if (options.relaxedSimd >= 0) wasmtime_config_wasm_relaxed_simd_set(config, options.relaxedSimd > 0);
+	if (options.memory64 >= 0) wasmtime_config_wasm_memory64_set(config, options.memory64 > 0);
+	if (options.parallelCompilation >= 0) {
+#ifdef WASMTIME_FEATURE_PARALLEL_COMPILATION
+		wasmtime_config_parallel_compilation_set(config, options.parallelCompilation > 0);
+#else
+		if (options.parallelCompilation > 0) std::cerr << "WCLAP: Wasmtime was built without parallel compilation\n";
+#endif
+	}
+	// Without an explicit target, Wasmtime compiles for the host and enables every CPU feature it detects (AVX2, AVX-512 etc.)
+	if (!options.target.empty()) {
+		error = wasmtime_config_target_set(config, options.target.c_str());
+		if (error) {
+			logError(error);
+			wasmtime_error_delete(error);
+			wasm_config_delete(config);
+			return false;
+		}
+	}
+	for (auto &flag : options.craneliftFlags) {
+		wasmtime_config_cranelift_flag_enable(config, flag.c_str());
+	}
+
+	globalPooling = false;
+	enginePoolBytes = 0;
+	if (options.pooling) {
+#ifdef WASMTIME_FEATURE_POOLING_ALLOCATOR
+		auto *pool = wasmtime_pooling_allocation_config_new();
+		uint32_t totalMemories = 1000, totalInstances = 1000; // Wasmtime's defaults
+		uint64_t maxMemorySize = uint64_t(1) << 32;
+		if (options.poolTotalInstances) {
+			// Every `Instance` is one core instance with its own function table, and (unless threaded) its own memory
+			totalInstances = options.poolTotalInstances;
+			wasmtime_pooling_allocation_config_total_core_instances_set(pool, totalInstances);
+			wasmtime_pooling_allocation_config_total_tables_set(pool, totalInstances);
+			totalMemories = totalInstances;
+		}
+		if (options.poolTotalMemories) totalMemories = options.poolTotalMemories;
+		if (options.poolTotalInstances || options.poolTotalMemories) {
+			wasmtime_pooling_allocation_config_total_memories_set(pool, totalMemories);
+		}
+		if (options.poolMaxUnusedWarmSlots) {
+			wasmtime_pooling_allocation_config_max_unused_warm_slots_set(pool, options.poolMaxUnusedWarmSlots);
+		}
+		if (options.poolMaxMemorySize) {
+			maxMemorySize = options.poolMaxMemorySize;
+			wasmtime_pooling_allocation_config_max_memory_size_set(pool, size_t(maxMemorySize));
+		}
+		wasmtime_pooling_allocation_strategy_set(config, pool);
+		wasmtime_pooling_allocation_config_delete(pool);
+		globalPooling = true;
+		// Each slot is sized for the largest memory (or the reservation, if bigger), plus its guard region
+		enginePoolBytes = uint64_t(totalMemories)*(std::max(maxMemorySize, engineMemoryReservation) + engineMemoryGuardSize);
+#else
+		std::cerr << "WCLAP: Wasmtime was built without the pooling allocator\n";
+		wasm_config_delete(config);
+		return false;
+#endif
+	}
+
 	globalWasmEngine = wasm_engine_new_with_config(config);
 	if (!globalWasmEngine) {
 		std::cerr << "couldn't create Wasmtime engine\n";
-		wasm_config_delete(config);
 		return false;
 	}
 
-	if (timeLimitMs > 0) {
+	if (options.timeLimitMs > 0) {
 		// start the epoch thread
 		globalEpochRunning = true;
 		globalEpochThread = std::thread{epochThreadFunction};
 	}
 	return true;
 }
+// Two independent 64-bit lanes, a word at a time - not cryptographic, so registry hits are also checked byte-for-byte
+wclap_wasmtime::ModuleKey wclap_wasmtime::ModuleKey::fromBytes(const unsigned char *bytes, size_t length) {
+	uint64_t a = 0xcbf29ce484222325ull, b = 0x9e3779b97f4a7c15ull ^ length;
+	auto mix = [&](uint64_t word) {
+		a = (a ^ word)*0x100000001b3ull;
+		a ^= a >> 29;
+		b = (b + word)*0xff51afd7ed558ccdull;
+		b ^= b >> 32;
+	};
+	size_t i = 0;
+	for (; i + 8 <= length; i += 8) {
+		uint64_t word;
+		std::memcpy(&word, bytes + i, 8);
+		mix(word);
+	}
+	uint64_t tail = 0;
+	std::memcpy(&tail, bytes + i, length - i);
+	mix(tail);
+	return {{a, b}, length};
+}
+
+namespace {
+	struct ModuleKeyHash {
+		size_t operator()(const wclap_wasmtime::ModuleKey &key) const {
+			return size_t(key.hash[0]);
+		}
+	};
+	struct RegisteredModule {
+		wasmtime_module_t *module;
+		size_t users;
+		std::vector<unsigned char> bytes; // the hash isn't cryptographic, so hits are confirmed against these
+	};
+	std::mutex moduleRegistryMutex;
+	std::unordered_map<wclap_wasmtime::ModuleKey, RegisteredModule, ModuleKeyHash> moduleRegistry;
+
+	bool sameBytes(const RegisteredModule &registered, const unsigned char *wasmBytes, size_t wasmLength) {
+		return registered.bytes.size() == wasmLength && !std::memcmp(registered.bytes.data(), wasmBytes, wasmLength);
+	}
+}
+
+wasmtime_module_t * wclap_wasmtime::InstanceGroup::acquireModule(const ModuleKey &key, const unsigned char *wasmBytes, size_t wasmLength, bool &registered, wasmtime_error_t **error) {
+	registered = false;
+	{
+		std::lock_guard<std::mutex> lock{moduleRegistryMutex};
+		auto iter = moduleRegistry.find(key);
+		if (iter != moduleRegistry.end() && sameBytes(iter->second, wasmBytes, wasmLength)) {
+			++iter->second.users;
+			registered = true;
+			return wasmtime_module_clone(iter->second.module);
+		}
+	}
+	// Compile without holding the lock, so other modules can load in parallel
+	wasmtime_module_t *module = nullptr;
+	*error = wasmtime_module_new(globalWasmEngine, wasmBytes, wasmLength, &module);
+	if (*error) return nullptr;
+
+	std::lock_guard<std::mutex> lock{moduleRegistryMutex};
+	auto iter = moduleRegistry.find(key);
+	if (iter != moduleRegistry.end()) {
+		// Different bytes with the same key (deliberately or not) get their own, unshared module
+		if (!sameBytes(iter->second, wasmBytes, wasmLength)) return module;
+		// Someone else compiled it at the same time
+		wasmtime_module_delete(module);
+		++iter->second.users;
+		registered = true;
+		return wasmtime_module_clone(iter->second.module);
+	}
+	moduleRegistry[key] = {module, 1, std::vector<unsigned char>(wasmBytes, wasmBytes + wasmLength)};
+	registered = true;
+	return wasmtime_module_clone(module);
+}
+void wclap_wasmtime::InstanceGroup::releaseModule(const ModuleKey &key) {
+	std::lock_guard<std::mutex> lock{moduleRegistryMutex};
+	auto iter = moduleRegistry.find(key);
+	if (iter == moduleRegistry.end()) return;
+	if (--iter->second.users == 0) {
+		wasmtime_module_delete(iter->second.module);
+		moduleRegistry.erase(iter);
+	}
+}
+
 void wclap_wasmtime::InstanceGroup::globalDeinit() {
 	if (globalEpochThread.joinable()) {
 		// stop the epoch thread
 		globalEpochRunning = false;
 		globalEpochThread.join();
 	}
+
+	{ // Compiled code belongs to the engine - should already be empty, since all WCLAPs are closed
+		std::lock_guard<std::mutex> lock{moduleRegistryMutex};
+		for (auto &pair : moduleRegistry) wasmtime_module_delete(pair.second.module);
+		moduleRegistry.clear();
+	}
 	
 	if (globalWasmEngine) {
 		wasm_engine_delete(globalWasmEngine);
@@ -78,7 +264,9 @@ void wclap_wasmtime::InstanceGroup::globalDeinit() {
 }
 
 void wclap_wasmtime::InstanceGroup::setup(const unsigned char *wasmBytes, size_t wasmLength) {
-	auto *error = wasmtime_module_new(globalWasmEngine, wasmBytes, wasmLength, &wtModule);
+	moduleKey = ModuleKey::fromBytes(wasmBytes, wasmLength);
+	wasmtime_error_t *error = nullptr;
+	wtModule = acquireModule(moduleKey, wasmBytes, wasmLength, moduleRegistered, &error);
 	if (error) {
 		setError(error);
 		return;
@@ -142,6 +330,7 @@ void wclap_wasmtime::InstanceGroup::setup(const unsigned char *wasmBytes, size_t
 				return;
 			}
 			if (!wtSharedMemory) return stopWithError("Shared memory wasn't created");
+			sharedMemoryAccount.update(wasmtime_sharedmemory_data_size(wtSharedMemory), false);
 			sharedMemoryImportModule = nameToStr(module);
 			sharedMemoryImportName = nameToStr(name);
 		}
@@ -158,6 +347,7 @@ bool wclap_wasmtime::InstanceImpl::setup() {
 
 	wtStore = wasmtime_store_new(globalWasmEngine, nullptr, nullptr);
 	if (!wtStore) return stopWithError("Failed to create store");
+	++liveStores;
 
 	wtContext = wasmtime_store_context(wtStore);
 	if (!wtContext) return stopWithError("Failed to get context");
@@ -288,6 +478,7 @@ bool wclap_wasmtime::InstanceImpl::setup() {
 	if (wasmtime_instance_export_get(wtContext, &wtInstance, "memory", 6, &item)) {
 		if (item.kind == WASMTIME_EXTERN_MEMORY) {
 			wtMemory = item.of.memory;
+			memoryAccount.update(wasmtime_memory_data_size(wtContext, &wtMemory), InstanceGroup::pooledMemories());
 		} else if (item.kind == WASMTIME_EXTERN_SHAREDMEMORY) {
 			// TODO: it should be the same as the import - not sure how to check this
 			if (!group.wtSharedMemory) {
@@ -401,6 +592,7 @@ bool wclap_wasmtime::InstanceImpl::wasiInit() {
 		setWasmDeadline();
 		wasm_trap_t *trap = nullptr;
 		auto error = wasmtime_func_call(wtContext, &item.of.func, nullptr, 0, nullptr, 0, &trap);
+		memoryMayHaveGrown();
 		if (error) {
 			group.setError(error);
 			wasmtime_extern_delete(&item);
@@ -446,6 +638,89 @@ bool wclap_wasmtime::InstanceImpl::updateClapEntry() {
 	return true;
 }
 
+bool wclap_wasmtime::InstanceImpl::takeSnapshot() {
+	std::lock_guard<std::recursive_mutex> lock(callMutex);
+	if (group.wtSharedMemory) return false; // other threads could be writing to it
+
+	auto snapshot = std::make_shared<InstanceGroup::Snapshot>();
+	const uint8_t *data = wasmtime_memory_data(wtContext, &wtMemory);
+	uint64_t size = wasmtime_memory_data_size(wtContext, &wtMemory);
+	snapshot->memorySize = size;
+	auto &chunks = snapshot->chunks;
+	for (uint64_t offset = 0; offset < size; offset += wasmPageSize) {
+		auto *start = data + offset, *end = data + std::min(size, offset + wasmPageSize);
+		if (std::all_of(start, end, [](uint8_t b){return b == 0;})) continue;
+		if (chunks.size() && chunks.back().offset + chunks.back().bytes.size() == offset) {
+			chunks.back().bytes.insert(chunks.back().bytes.end(), start, end);
+		} else {
+			chunks.push_back({offset, {start, end}});
+		}
+	}
+
+	char *name;
+	size_t nameLength;
+	wasmtime_extern_t item;
+	for (size_t i = 0; wasmtime_instance_export_nth(wtContext, &wtInstance, i, &name, &nameLength, &item); ++i) {
+		if (item.kind == WASMTIME_EXTERN_GLOBAL) {
+			wasm_globaltype_t *type = wasmtime_global_type(wtContext, &item.of.global);
+			bool isMutable = (wasm_globaltype_mutability(type) == WASM_VAR);
+			wasm_globaltype_delete(type);
+			if (isMutable) {
+				wasmtime_val_t value;
+				wasmtime_global_get(wtContext, &item.of.global, &value);
+				if (value.kind <= WASMTIME_V128) { // we can't carry references across stores
+					snapshot->globals.push_back({std::string{name, nameLength}, value});
+				}
+			}
+		}
+		wasmtime_extern_delete(&item);
+	}
+
+	auto groupLock = group.lock();
+	group.snapshot = snapshot;
+	return true;
+}
+
+bool wclap_wasmtime::InstanceImpl::restoreSnapshot(const InstanceGroup::Snapshot &snapshot) {
+	std::lock_guard<std::recursive_mutex> lock(callMutex);
+	if (group.wtSharedMemory) return false;
+
+	uint64_t size = wasmtime_memory_data_size(wtContext, &wtMemory);
+	if (size > snapshot.memorySize) return false; // memory can't shrink
+	// The snapshot only has the non-zero pages, so clear out the data segments from instantiation
+	std::memset(wasmtime_memory_data(wtContext, &wtMemory), 0, size);
+	if (snapshot.memorySize > size) {
+		uint64_t prevPages;
+		auto *error = wasmtime_memory_grow(wtContext, &wtMemory, (snapshot.memorySize - size)/wasmPageSize, &prevPages);
+		if (error) {
+			group.setError(error);
+			return false;
+		}
+	}
+	uint8_t *data = wasmtime_memory_data(wtContext, &wtMemory);
+	for (auto &chunk : snapshot.chunks) {
+		std::memcpy(data + chunk.offset, chunk.bytes.data(), chunk.bytes.size());
+	}
+	memoryMayHaveGrown();
+
+	for (auto &global : snapshot.globals) {
+		wasmtime_extern_t item;
+		if (!wasmtime_instance_export_get(wtContext, &wtInstance, global.name.data(), global.name.size(), &item)) return false;
+		if (item.kind != WASMTIME_EXTERN_GLOBAL) {
+			wasmtime_extern_delete(&item);
+			return false;
+		}
+		auto *error = wasmtime_global_set(wtContext, &item.of.global, &global.value);
+		wasmtime_extern_delete(&item);
+		if (error) {
+			group.setError(error);
+			return false;
+		}
+	}
+
+	return updateClapEntry();
+}
+
 void wclap_wasmtime::InstanceImpl::runThread(uint32_t threadId, uint64_t threadArg) {
 	auto stopWithError = [&](const char *message) -> void {
 		group.setError(message);
@@ -507,6 +782,7 @@ uint64_t wclap_wasmtime::InstanceImpl::wtMalloc(size_t bytes) {
 	{
 		wasm_trap_t *trap = nullptr;
 		auto error = wasmtime_func_call(wtContext, &wtMallocFunc, args, 1, results, 1, &trap);
+		memoryMayHaveGrown();
 		if (error) {
 			group.setError(error);
 			group.setError("calling malloc() failed");
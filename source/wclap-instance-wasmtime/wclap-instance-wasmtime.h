@@ -12,8 +12,10 @@
 #include <iostream>
 #include <mutex>
 #include <shared_mutex>
+#include <atomic>
 #include <type_traits>
 #include <string>
+#include <string_view>
 #include <cstring>
 #include <filesystem>
 #include <vector>
@@ -284,26 +286,132 @@ std::tuple<void *, Args...> argsAsTuple(void *context, wasmtime_val_raw_t *wasmA
     return {context, wasmValToArg<Args>(wasmArgs[Is])...};
 }
 
+//---------- Engine configuration ----------
+
+// Negative values keep Wasmtime's default
+struct EngineOptions {
+	unsigned int timeLimitMs = 0;
+	int64_t memoryReservation = -1;
+	int64_t memoryReservationForGrowth = -1;
+	int64_t memoryGuardSize = -1;
+	int memoryInitCow = -1;
+	bool pooling = false;
+	// Only used with `pooling`, 0 keeps Wasmtime's default
+	uint32_t poolTotalMemories = 0;
+	uint32_t poolTotalInstances = 0;
+	uint32_t poolMaxUnusedWarmSlots = 0;
+	uint64_t poolMaxMemorySize = 0;
+
+	int optLevel = -1; // 0 = none, 1 = speed, 2 = speed and size
+	int simd = -1, relaxedSimd = -1, memory64 = -1;
+	int parallelCompilation = -1;
+	std::string target; // empty means the host, with its CPU features detected
+	std::vector<std::string> craneliftFlags;
+};
+
+// The engine's actual settings (defaults filled in), for estimating address-space use
+inline uint64_t engineMemoryReservation = 0, engineMemoryReservationForGrowth = 0, engineMemoryGuardSize = 0;
+inline uint64_t enginePoolBytes = 0; // reserved up-front by the pooling allocator
+
+inline std::atomic<uint64_t> liveStores = 0;
+inline std::atomic<uint64_t> liveMemories = 0;
+inline std::atomic<uint64_t> liveMemoryBytes = 0; // current sizes, as last seen by the bridge
+inline std::atomic<uint64_t> liveVirtualBytes = 0; // estimated reservation (incl. guard) for memories outside the pool
+
+// Tracks one linear memory's contribution to the totals above
+struct MemoryAccount {
+	void update(uint64_t size, bool pooled) {
+		uint64_t virtualSize = 0;
+		if (!pooled) {
+			// Wasmtime reserves the whole region up-front while the memory fits, and moves it (with extra room for growth) when it doesn't
+			virtualSize = (size <= engineMemoryReservation ? engineMemoryReservation : size + engineMemoryReservationForGrowth) + engineMemoryGuardSize;
+		}
+		if (!counted.exchange(true)) ++liveMemories;
+		liveMemoryBytes += size - bytes.exchange(size);
+		liveVirtualBytes += virtualSize - virtualBytes.exchange(virtualSize);
+	}
+	~MemoryAccount() {
+		if (!counted) return;
+		--liveMemories;
+		liveMemoryBytes -= bytes;
+		liveVirtualBytes -= virtualBytes;
+	}
+private:
+	std::atomic<bool> counted = false;
+	std::atomic<uint64_t> bytes = 0, virtualBytes = 0;
+};
+
+struct MemoryFootprint {
+	uint64_t stores, memories, memoryBytes, virtualBytes, poolBytes;
+};
+inline MemoryFootprint memoryFootprint() {
+	return {liveStores, liveMemories, liveMemoryBytes, liveVirtualBytes, enginePoolBytes};
+}
+
 //---------- Actual implementations ----------
 
+static constexpr uint64_t wasmPageSize = 65536;
+
 struct InstanceImpl;
 
+// Identifies a module's bytes, for sharing compiled code between groups opened from the same file
+struct ModuleKey {
+	uint64_t hash[2];
+	size_t length;
+
+	static ModuleKey fromBytes(const unsigned char *bytes, size_t length);
+	bool operator==(const ModuleKey &other) const {
+		return hash[0] == other.hash[0] && hash[1] == other.hash[1] && length == other.length;
+	}
+};
+
 struct InstanceGroup {
 	bool hadInit = false;
 	bool is64() const {
 		return wasm64;
 	}
+	// Only WCLAPs which import shared memory can have more than one `Instance`
+	bool isThreaded() const {
+		return wtSharedMemory != nullptr;
+	}
 
-	static bool globalInit(unsigned int timeLimitMs);
+	static bool globalInit(const EngineOptions &options);
 	static void globalDeinit();
-	
+	static bool pooledMemories();
+	// Compiled modules are shared (by content) between all groups which are using them
+	static wasmtime_module_t * acquireModule(const ModuleKey &key, const unsigned char *wasmBytes, size_t wasmLength, bool &registered, wasmtime_error_t **error);
+	static void releaseModule(const ModuleKey &key);
+
 	wasmtime_module_t *wtModule = nullptr;
+	bool moduleRegistered = false; // if so, release `moduleKey` when we're done
+	ModuleKey moduleKey;
 	wasmtime_error_t *wtError = nullptr;
 	wasmtime_sharedmemory_t *wtSharedMemory = nullptr;
+	MemoryAccount sharedMemoryAccount;
 	std::string sharedMemoryImportModule, sharedMemoryImportName;
 	const char *constantErrorMessage = nullptr;
 
+	// While one of these exists, errors on this thread are collected into `failure` instead of breaking the whole group - for optional instances (e.g. a thread pool) which can just be dropped
+	struct ErrorRedirect {
+		ErrorRedirect(std::string &failure) : previous(redirectErrors) {
+			redirectErrors = &failure;
+		}
+		~ErrorRedirect() {
+			redirectErrors = previous;
+		}
+	private:
+		std::string *previous;
+	};
+
+	// Returns `true` if there's an `ErrorRedirect` on this thread (which keeps the first message)
+	static bool redirectError(const char *message) {
+		if (!redirectErrors) return false;
+		if (redirectErrors->empty()) *redirectErrors = message;
+		return true;
+	}
+
 	bool setError(const char *message) {
+		if (redirectError(message)) return true;
 		auto groupLock = lock();
 		if (hasError()) {
 			std::cerr << "WCLAP: " << message << std::endl;
@@ -314,6 +422,11 @@ struct InstanceGroup {
 	}
 	bool setError(wasmtime_error_t *e) {
 		if (!e) return false;
+		if (redirectErrors) {
+			logError(e);
+			wasmtime_error_delete(e);
+			return redirectError("Wasmtime error (see log)");
+		}
 		if (hasError()) {
 			// Keep first error, but log the new one
 			logError(e);
@@ -349,6 +462,24 @@ struct InstanceGroup {
 	}
 
 	std::optional<std::string> wclapDir, presetDir, cacheDir, varDir;
+
+	// Linear memory and (exported, mutable) globals captured after `clap_entry::init()`, so isolated copies can skip the WCLAP's own initialisation
+	struct Snapshot {
+		uint64_t memorySize = 0;
+		struct Chunk {
+			uint64_t offset;
+			std::vector<uint8_t> bytes;
+		};
+		std::vector<Chunk> chunks; // only the non-zero pages
+		struct Global {
+			std::string name;
+			wasmtime_val_t value;
+		};
+		std::vector<Global> globals;
+	};
+	std::shared_ptr<const Snapshot> snapshot;
+	bool startedFromSnapshot = false;
+
 	static std::optional<std::string> optStr(const char *str) {
 		if (!str) return {};
 		return {std::string{str}};
@@ -361,10 +492,13 @@ struct InstanceGroup {
 		// early returns are easier in normal functions
 		setup(wasmBytes, wasmLength);
 	}
+	// Another group for the same compiled module, with its own store/instance/memory - only possible for single-threaded WCLAPs
+	InstanceGroup * isolatedCopy() const;
 	~InstanceGroup() {
 		if (wtSharedMemory) wasmtime_sharedmemory_delete(wtSharedMemory);
 		if (wtError) wasmtime_error_delete(wtError);
 		if (wtModule) wasmtime_module_delete(wtModule);
+		if (moduleRegistered) releaseModule(moduleKey);
 	}
 	
 	std::optional<std::string> mapPath(const std::string &virtualPath) {
@@ -393,6 +527,10 @@ struct InstanceGroup {
 	void * wasiThreadSpawnContext = nullptr;
 	int32_t (*wasiThreadSpawn)(void *context, uint64_t threadArg) = nullptr;
 
+	// Optional: called (for progress reporting) just before the WCLAP's own initialisation - returning `false` cancels it
+	void * initHookContext = nullptr;
+	bool (*initHook)(void *context) = nullptr;
+
 	static wasm_trap_t * wtWasiThreadSpawn(void *context, wasmtime_caller *, wasmtime_val_raw *values, size_t argCount);
 
 	std::unique_lock<std::recursive_mutex> lock() const {
@@ -401,6 +539,9 @@ struct InstanceGroup {
 private:
 	mutable std::recursive_mutex groupMutex;
 	bool wasm64 = false;
+	static inline thread_local std::string *redirectErrors = nullptr;
+
+	InstanceGroup(const InstanceGroup &parent, wasmtime_module_t *sharedModule) : wtModule(sharedModule), wclapDir(parent.wclapDir), presetDir(parent.presetDir), cacheDir(parent.cacheDir), varDir(parent.varDir), snapshot(parent.snapshot), wasm64(parent.wasm64) {}
 };
 
 struct InstanceImpl {
@@ -421,13 +562,18 @@ struct InstanceImpl {
 	wasmtime_func_t wtMallocFunc; // direct export
 	wasmtime_instance_t wtInstance;
 
+	MemoryAccount memoryAccount; // only used if we have our own (non-shared) memory
+
 	InstanceImpl(void *handle, InstanceGroup &group) : handle(handle), group(group) {
 		if (!setup()) return;
 	}
 	InstanceImpl(const InstanceImpl &other) = delete;
 	~InstanceImpl() {
 		if (wtLinker) wasmtime_linker_delete(wtLinker);
-		if (wtStore) wasmtime_store_delete(wtStore);
+		if (wtStore) {
+			wasmtime_store_delete(wtStore);
+			--liveStores;
+		}
 	}
 	bool setup(); // creates the thread stuff - always called, basically part of the constructor
 	
@@ -452,7 +598,17 @@ struct InstanceImpl {
 			group.setError("Tried to `.init()` WCLAP twice");
 			return 0;
 		}
-		if (!wasiInit()) {
+		if (group.initHook && !group.initHook(group.initHookContext)) {
+			group.setError("cancelled before initialisation");
+			return 0;
+		}
+		if (group.snapshot) {
+			if (!restoreSnapshot(*group.snapshot)) {
+				group.setError("failed to restore WCLAP from snapshot");
+				return 0;
+			}
+			group.startedFromSnapshot = true;
+		} else if (!wasiInit()) {
 			group.setError("`.wasiInit()` returned false");
 			return 0;
 		}
@@ -465,20 +621,130 @@ struct InstanceImpl {
 	void setWasmDeadline();
 	bool wasiInit(); // calls `_initialize()`, only once per InstanceGroup
 	bool updateClapEntry();
+	// Single-threaded WCLAPs only: after these, `.init()` on another group sharing the snapshot skips `_initialize()`
+	bool takeSnapshot();
+	bool restoreSnapshot(const InstanceGroup::Snapshot &snapshot);
 	
 	uint64_t wtMalloc(size_t bytes);
 
-	uint8_t * wasmMemory(uint64_t wasmP, uint64_t size) {
+	// Cached base/size for the linear memory, so most accesses don't have to lock and ask Wasmtime
+	std::atomic<uint64_t> memoryGeneration = 1; // bumped whenever WCLAP code has run, since it might have grown the memory
+	std::atomic<uint64_t> memoryViewGeneration = 0;
+	// Base and size are published together, so readers never pair one memory's base with another's size.  Old views are kept until the instance is destroyed, since readers might still hold them (there's one per grow/move, not per refresh).
+	struct MemoryView {
+		uint8_t *base;
+		uint64_t size;
+	};
+	MemoryView emptyMemoryView{nullptr, 0};
+	std::atomic<const MemoryView *> currentMemoryView = &emptyMemoryView;
+	std::mutex memoryViewMutex;
+	std::vector<std::unique_ptr<MemoryView>> memoryViews;
+
+	void memoryMayHaveGrown() {
+		++memoryGeneration;
+	}
+	void publishMemoryView(uint8_t *base, uint64_t size) {
+		std::lock_guard<std::mutex> lock{memoryViewMutex};
+		auto *current = currentMemoryView.load();
+		// Memories never shrink, so a smaller size at the same address is just an older (racing) refresh
+		if (current->base == base && current->size >= size) return;
+		memoryViews.emplace_back(new MemoryView{base, size});
+		currentMemoryView = memoryViews.back().get();
+	}
+	void refreshMemoryView() {
+		auto generation = memoryGeneration.load();
 		if (group.wtSharedMemory) {
-			auto memorySize = wasmtime_sharedmemory_data_size(group.wtSharedMemory);
-			wasmP = std::min<uint64_t>(wasmP, memorySize - size);
-			return wasmtime_sharedmemory_data(group.wtSharedMemory) + wasmP;
+			// Shared memory is never moved, only grown
+			auto size = wasmtime_sharedmemory_data_size(group.wtSharedMemory);
+			publishMemoryView(wasmtime_sharedmemory_data(group.wtSharedMemory), size);
+			group.sharedMemoryAccount.update(size, false);
 		} else {
 			std::lock_guard<std::recursive_mutex> lock(callMutex);
-			auto memorySize = wasmtime_memory_data_size(wtContext, &wtMemory);
-			wasmP = std::min<uint64_t>(wasmP, memorySize - size);
-			return wasmtime_memory_data(wtContext, &wtMemory) + wasmP;
+			auto size = wasmtime_memory_data_size(wtContext, &wtMemory);
+			publishMemoryView(wasmtime_memory_data(wtContext, &wtMemory), size);
+			memoryAccount.update(size, InstanceGroup::pooledMemories());
+		}
+		memoryViewGeneration = generation;
+	}
+	uint8_t * memoryView(uint64_t &memorySize) {
+		if (memoryViewGeneration.load() != memoryGeneration.load()) refreshMemoryView();
+		auto *view = currentMemoryView.load();
+		memorySize = view->size;
+		return view->base;
+	}
+	// Bounds-checked: returns `nullptr` if any of the range is outside the memory
+	uint8_t * memoryRange(uint64_t wasmP, uint64_t size) {
+		uint64_t memorySize;
+		auto *base = memoryView(memorySize);
+		if (wasmP > memorySize || size > memorySize - wasmP) {
+			// The memory might have grown since we last looked (e.g. from another thread)
+			refreshMemoryView();
+			base = memoryView(memorySize);
+			if (wasmP > memorySize || size > memorySize - wasmP) return nullptr;
+		}
+		return base + wasmP;
+	}
+	template<class V>
+	V * view(wclap32::Pointer<V> ptr, size_t count=1) {
+		return (V *)memoryRange(ptr.wasmPointer, sizeof(V)*count);
+	}
+	template<class V>
+	V * view(wclap64::Pointer<V> ptr, size_t count=1) {
+		return (V *)memoryRange(ptr.wasmPointer, sizeof(V)*count);
+	}
+
+	uint8_t * wasmMemory(uint64_t wasmP, uint64_t size) {
+		if (auto *direct = memoryRange(wasmP, size)) return direct;
+		// Out of bounds, so clamp to keep it inside the memory
+		uint64_t memorySize;
+		auto *base = memoryView(memorySize);
+		wasmP = std::min<uint64_t>(wasmP, memorySize - size);
+		return base + wasmP;
+	}
+
+	// Null-terminated string read directly from WASM memory (bounds-checked, and stopping at `maxLength`) - only valid until the WCLAP next runs
+	std::string_view getStringView(uint64_t wasmP, size_t maxLength, bool *terminated=nullptr) {
+		if (terminated) *terminated = false;
+		if (!wasmP) return {};
+		uint64_t memorySize;
+		const uint8_t *data = memoryView(memorySize);
+		if (wasmP >= memorySize) {
+			refreshMemoryView();
+			data = memoryView(memorySize);
+			if (wasmP >= memorySize) return {};
 		}
+		auto available = size_t(std::min<uint64_t>(maxLength, memorySize - wasmP));
+		auto *start = (const char *)(data + wasmP);
+		auto *end = (const char *)std::memchr(start, 0, available);
+		if (terminated) *terminated = (end != nullptr);
+		return {start, end ? size_t(end - start) : available};
+	}
+	template<class V>
+	std::string_view getStringView(wclap32::Pointer<V> ptr, size_t maxLength, bool *terminated=nullptr) {
+		return getStringView(uint64_t(ptr.wasmPointer), maxLength, terminated);
+	}
+	template<class V>
+	std::string_view getStringView(wclap64::Pointer<V> ptr, size_t maxLength, bool *terminated=nullptr) {
+		return getStringView(uint64_t(ptr.wasmPointer), maxLength, terminated);
+	}
+
+	// For native calls which need null-termination: points into WASM memory if that's safe, otherwise copies (truncated) into `buffer`.  A null pointer stays null.
+	template<class P, size_t N>
+	const char * getCString(P ptr, char (&buffer)[N], size_t maxLength=N - 1) {
+		return getCString(ptr, buffer, N, maxLength);
+	}
+	template<class P>
+	const char * getCString(P ptr, char *buffer, size_t bufferSize, size_t maxLength) {
+		if (!ptr) return nullptr;
+		maxLength = std::min(maxLength, bufferSize - 1);
+		bool terminated;
+		auto view = getStringView(ptr, maxLength + 1, &terminated);
+		// Other threads can write to shared memory while we're reading, so we can't rely on the terminator staying put
+		if (terminated && !group.wtSharedMemory) return view.data();
+		auto length = std::min(view.size(), maxLength);
+		if (length) std::memcpy(buffer, view.data(), length);
+		buffer[length] = 0;
+		return buffer;
 	}
 
 	void wtCall(uint64_t fnP, wasmtime_val_raw *argsAndResults, size_t argN) {
@@ -504,6 +770,7 @@ struct InstanceImpl {
 		setWasmDeadline();
 		wasm_trap_t *trap = nullptr;
 		auto *error = wasmtime_func_call_unchecked(wtContext, &funcVal.of.funcref, argsAndResults, 1, &trap);
+		memoryMayHaveGrown();
 		
 		if (error) {
 			group.setError(error);
@@ -554,6 +821,30 @@ struct InstanceImpl {
 		return true;
 	}
 
+	// Gather/scatter between separate native arrays and one block (e.g. all the channels for an audio port), `stride` apart (default: contiguous)
+	template<class P, class V>
+	bool setArrays(P block, const V * const *values, size_t arrayCount, size_t length, size_t stride=0) {
+		if (!stride) stride = length;
+		if (!arrayCount) return true;
+		auto *wasmMem = view(block, (arrayCount - 1)*stride + length);
+		if (!wasmMem) return false;
+		for (size_t i = 0; i < arrayCount; ++i) {
+			std::memcpy(wasmMem + i*stride, values[i], sizeof(V)*length);
+		}
+		return true;
+	}
+	template<class P, class V>
+	bool getArrays(P block, V * const *results, size_t arrayCount, size_t length, size_t stride=0) {
+		if (!stride) stride = length;
+		if (!arrayCount) return true;
+		auto *wasmMem = view(block, (arrayCount - 1)*stride + length);
+		if (!wasmMem) return false;
+		for (size_t i = 0; i < arrayCount; ++i) {
+			std::memcpy(results[i], wasmMem + i*stride, sizeof(V)*length);
+		}
+		return true;
+	}
+
 	template<class Return, class... Args>
 	Return call(wclap32::Function<Return, Args...> fnPtr, Args... args) {
 		if constexpr (std::is_void_v<Return>) {
@@ -609,11 +900,13 @@ struct InstanceImpl {
 		if (group.hasError()) return -1;
 
 		struct WrappedFn {
+			InstanceImpl *instance;
 			void *context;
 			Return (*nativeFn)(void *, Args...);
 			
 			static wasm_trap_t * unchecked(void *env, wasmtime_caller_t *caller, wasmtime_val_raw_t *argsResults, size_t argsResultsLength) {
 				auto &wrapped = *(WrappedFn *)env;
+				wrapped.instance->memoryMayHaveGrown();
 				auto args = argsAsTuple<Args...>(wrapped.context, argsResults, std::index_sequence_for<Args...>{});
 				if constexpr (std::is_void_v<Return>) {
 					std::apply(wrapped.nativeFn, args);
@@ -627,7 +920,7 @@ struct InstanceImpl {
 				delete wrapped;
 			}
 		};
-		auto *wrapped = new WrappedFn(WrappedFn{context, nativeFn});
+		auto *wrapped = new WrappedFn(WrappedFn{this, context, nativeFn});
 
 		// get the function type
 		wasmtime_val_t fnVal{WASMTIME_FUNCREF};
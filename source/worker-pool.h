@@ -0,0 +1,64 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace wclap_bridge {
+
+// Fixed set of threads running queued tasks in order.  Threads start with the first task.
+struct WorkerPool {
+	~WorkerPool() {
+		stop();
+	}
+
+	void push(size_t threadCount, std::function<void()> task) {
+		std::lock_guard<std::mutex> lock{mutex};
+		if (workers.empty()) {
+			stopping = false;
+			for (size_t i = 0; i < std::max<size_t>(threadCount, 1); ++i) {
+				workers.emplace_back([this](){run();});
+			}
+		}
+		tasks.push_back(std::move(task));
+		wake.notify_one();
+	}
+
+	// Runs everything already queued, then stops the threads
+	void stop() {
+		std::vector<std::thread> stopped;
+		{
+			std::lock_guard<std::mutex> lock{mutex};
+			stopping = true;
+			wake.notify_all();
+			std::swap(stopped, workers);
+		}
+		for (auto &thread : stopped) thread.join();
+	}
+
+private:
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::deque<std::function<void()>> tasks;
+	std::vector<std::thread> workers;
+	bool stopping = false;
+
+	void run() {
+		std::unique_lock<std::mutex> lock{mutex};
+		while (true) {
+			wake.wait(lock, [&](){return stopping || !tasks.empty();});
+			if (tasks.empty()) return; // only when stopping
+			auto task = std::move(tasks.front());
+			tasks.pop_front();
+			lock.unlock();
+			task();
+			lock.lock();
+		}
+	}
+};
+
+}; // namespace